@@ -32,9 +32,47 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <stdio.h>
 #include <stdint.h>
 #include <memory.h>
+#include <string.h>
 
 #define MDEFLATE_DEBUG_PRINTF 0
-#define WITH_LITERAL_ONLY_TREE 1
+#define WITH_THREADS 1
+#define WITH_WIDE_BIT_READER 1
+#define WITH_LITERAL_PAIR_LUT 1
+#define WITH_BYTE_LITERALS 1
+#ifndef WITH_STAGE_TIMERS
+#define WITH_STAGE_TIMERS 0 /* the bench build sets it on the command line */
+#endif
+#define WITH_CPU_DISPATCH 1
+#define WITH_BENCH 1 /* bench mode of main(), needs the POSIX clock_gettime and dirent.h */
+
+#if WITH_THREADS
+#include <pthread.h>
+#endif
+#if WITH_BENCH || WITH_STAGE_TIMERS
+#include <time.h>
+#endif
+#if WITH_BENCH
+#include <dirent.h>
+#endif
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+/* x86 builds with gcc or clang compile some kernels once more for newer instruction sets and pick them per context
+   for the running cpu. MDEFLATE_KERNEL bodies are inlined into every variant */
+#if WITH_CPU_DISPATCH && defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define MDEFLATE_DISPATCH 1
+#define MDEFLATE_TARGET( pc_target ) __attribute__(( target( pc_target ) ))
+#define MDEFLATE_KERNEL static inline __attribute__(( always_inline ))
+#else
+#define MDEFLATE_DISPATCH 0
+#define MDEFLATE_KERNEL static inline
+#endif
+
+#define MDEFLATE_CPU_SSE2  1
+#define MDEFLATE_CPU_SSSE3 2
+#define MDEFLATE_CPU_AVX2  4
+#define MDEFLATE_CPU_BMI2  8
 
 #define MDEFLATE_MAX_LITERAL_NODE   15
 #define MDEFLATE_MAX_LITERAL_NODES  16
@@ -45,80 +83,460 @@ POSSIBILITY OF SUCH DAMAGE.
 #define MDEFLATE_MAX_MATCH_LENGTH  256
 #define MDEFLATE_MAX_SYMBOL_NODES ( MDEFLATE_END_OF_BLOCK_NODE + MDEFLATE_MAX_LENGTH_NODES + 1 )
 #define MDEFLATE_MAX_OFFSET_NODES  32
-#define MDEFLATE_MAX_CODEBOOK_BACK ( 1 << 14 )
+#define MDEFLATE_BYTE_END_OF_BLOCK_NODE 256
+#define MDEFLATE_BYTE_NODES_OFFSET ( MDEFLATE_BYTE_END_OF_BLOCK_NODE - MDEFLATE_END_OF_BLOCK_NODE ) /* byte tree node of the end of block and length symbols */
+#define MDEFLATE_MAX_BYTE_NODES ( MDEFLATE_BYTE_END_OF_BLOCK_NODE + MDEFLATE_MAX_LENGTH_NODES + 1 )
 
 #define MDEFLATE_BLOCK_SIZE ( 1 << 14 )
+#define MDEFLATE_MAX_ENC_BLOCK_SIZE ( MDEFLATE_BLOCK_SIZE + MDEFLATE_BLOCK_SIZE / 5 )
 #define MDEFLATE_MAX_CW_LENGTH 8
+#define MDEFLATE_MAX_BYTE_CW_LENGTH 12
+#define MDEFLATE_STORED_BLOCK_HEADER 4 /* zero bytes, a huffman block never starts with 27 zero bits */
+#define MDEFLATE_BLOCK_TYPE_BITS 32 /* 27 zero bits and the block type of a block without bit length header */
+#define MDEFLATE_BLOCK_TYPE_STORED 0
+#define MDEFLATE_BLOCK_TYPE_REUSE  1 /* huffman block with the tables of the previous one */
+#define MDEFLATE_BLOCK_TYPE_SHARED 2 /* huffman block whose high literal nibbles use the symbol tree, its header follows */
+#define MDEFLATE_BLOCK_TYPE_BYTE   3 /* huffman block with a tree of whole literal bytes, end of block and length symbols, its header follows */
+#define MDEFLATE_BLOCK_TYPE_SEPARATE 4 /* statistics only, the default huffman block starts with its header right away */
+#define MDEFLATE_NUM_BLOCK_TYPES   5
+#define MDEFLATE_MAX_BLOCK_HEADER_SIZE 269 /* block type, 13 bit lengths of 3 bits and 297 code lengths of up to 7 bits */
+/* every split block is at most a stored block, the last one may overshoot by its header and 16 bytes of codewords before it is abandoned */
+#define MDEFLATE_ENC_BLOCK_BOUND( n ) ( ( n ) + MDEFLATE_SPLIT_SEGMENTS * ( MDEFLATE_STORED_BLOCK_HEADER + 4 ) + MDEFLATE_MAX_BLOCK_HEADER_SIZE + 16 )
+
+#define MDEFLATE_MIN_LOG 12
+#define MDEFLATE_MAX_LOG 20
+#define MDEFLATE_DEFAULT_WINDOW_LOG 14
+#define MDEFLATE_DEFAULT_BLOCK_LOG  13
+#define MDEFLATE_MAX_OFFSET_EXTRA 16
+#define MDEFLATE_OFFSET_EXTRA_PREFIX 5
+#define MDEFLATE_HEADER_SIZE 4
+#if ( ( 'M' << 8 ) | 'D' ) <= MDEFLATE_MAX_ENC_BLOCK_SIZE
+#error "stream header can not be told apart from a legacy block length"
+#endif
 
+#define MDEFLATE_MAX_TREE_NODES MDEFLATE_MAX_BYTE_NODES
 #define MDEFLATE_MAX_BL_NODES ( MDEFLATE_MAX_CW_LENGTH + 1 )
+#define MDEFLATE_MAX_BYTE_BL_NODES ( MDEFLATE_MAX_BYTE_CW_LENGTH + 1 )
 #define MDEFLATE_MAX_BL_CW_LENGTH 7
 
+#define MINFLATE_PAIR_LUT_BITS 11
+#define MINFLATE_OUT_SLACK 16
+#define MINFLATE_PAIR_LUT ( WITH_WIDE_BIT_READER && WITH_LITERAL_PAIR_LUT )
+#define MINFLATE_BYTE_SUB_BITS ( MDEFLATE_MAX_BYTE_CW_LENGTH - MDEFLATE_MAX_CW_LENGTH )
+#define MINFLATE_BYTE_LUT_SIZE ( ( 1 << MDEFLATE_MAX_CW_LENGTH ) + ( ( MDEFLATE_MAX_BYTE_NODES / 2 ) << MINFLATE_BYTE_SUB_BITS ) ) /* a second level table holds at least 2 codes */
+#define MINFLATE_BYTE_LUT_LINK 0x8000
+#define MINFLATE_BYTE_LENGTH_SHIFT 9
+#if MINFLATE_PAIR_LUT_BITS < MDEFLATE_MAX_CW_LENGTH || MINFLATE_PAIR_LUT_BITS > 2 * MDEFLATE_MAX_CW_LENGTH
+#error "MINFLATE_PAIR_LUT_BITS out of range"
+#endif
+
+#define MDEFLATE_HASH_BITS 14
+#define MDEFLATE_HASH_SIZE ( 1 << MDEFLATE_HASH_BITS )
+
+#define MDEFLATE_STRATEGY_STORE     0 /* no match search, the literals are still huffman coded */
+#define MDEFLATE_STRATEGY_GREEDY    1
+#define MDEFLATE_STRATEGY_LAZY      2
+#define MDEFLATE_STRATEGY_DEEP_LAZY 3
+#define MDEFLATE_STRATEGY_OPTIMAL   4
+
+#define MDEFLATE_TREE_SEPARATE 0 /* low literal nibbles share the symbol tree, high ones have a literal only tree */
+#define MDEFLATE_TREE_SHARED   1 /* both literal nibbles use the symbol tree */
+#define MDEFLATE_TREE_BYTE     2 /* whole literal bytes, end of block and length symbols in the byte tree */
+
+#define MDEFLATE_JOB_BLOCKS  16
+#define MDEFLATE_MAX_THREADS 256
+#define MDEFLATE_MAX_CHUNK_SIZE ( 1 << 28 )
+
+#define MDEFLATE_INDEX_ENTRY_SIZE 16
+#define MDEFLATE_INDEX_TRAILER_SIZE 16
+#define MDEFLATE_INDEX_SIZE( entries ) ( ( int64_t )( entries ) * MDEFLATE_INDEX_ENTRY_SIZE + MDEFLATE_INDEX_TRAILER_SIZE )
+#define MDEFLATE_STREAM_NO_FLUSH 0
+#define MDEFLATE_STREAM_FLUSH    1
+#define MDEFLATE_STREAM_FINISH   2
+
+#define MDEFLATE_MIN_LEVEL     0
+#define MDEFLATE_MAX_LEVEL     9
+#define MDEFLATE_DEFAULT_LEVEL 5
+#define MDEFLATE_OPTIMAL_MAX_MATCHES 8
+#define MDEFLATE_OPTIMAL_PASSES 2
+#define MDEFLATE_UNUSED_SYMBOL_PRICE ( MDEFLATE_MAX_CW_LENGTH + 1 )
+#define MDEFLATE_SPLIT_SEGMENTS 16
+#define MDEFLATE_SPLIT_MIN_SEGMENT 512
+#define MDEFLATE_PROBE_MIN_LENGTH 1024
+#define MDEFLATE_PROBE_HASH_BITS 13
+#define MDEFLATE_PROBE_STEP 16
+#define MDEFLATE_PROBE_STORED_BITS 2022 /* 7.9 bits per byte in 1/256 bits */
+#define MDEFLATE_PROBE_REPEAT_RATE 1024 /* matches are searched if more than 1 in 1024 positions repeats a sampled position, about 1 in 64 repeats 4 bytes */
+#define MDEFLATE_SPLIT_BLOCK_BITS 224 /* estimated bit length header, end of block symbol and padding of a block */
+#define MDEFLATE_SPLIT_NODES ( MDEFLATE_MAX_SYMBOL_NODES + MDEFLATE_MAX_LITERAL_NODES + MDEFLATE_MAX_OFFSET_NODES )
+#define MDEFLATE_TRAIN_KMER 6 /* bytes hashed per position when training a dictionary */
+#define MDEFLATE_TRAIN_SEGMENT 256
+#define MDEFLATE_TRAIN_HASH_BITS 20
+
+#define MDEFLATE_STAGE_MATCH   0 /* probe, hashing and parse, mostly the match search */
+#define MDEFLATE_STAGE_TREE    1 /* mdeflate_construct_tree */
+#define MDEFLATE_STAGE_HEADER  2
+#define MDEFLATE_STAGE_SYMBOLS 3
+#define MINFLATE_STAGE_TABLES  4 /* block header and lut build */
+#define MINFLATE_STAGE_DECODE  5
+#define MDEFLATE_NUM_STAGES    6
+#if WITH_STAGE_TIMERS
+#define MDEFLATE_STAGE_START( ps, stage ) ( ( ps )->ps_stats != NULL ? ( ps )->ps_stats->rgi64_stage_ticks[ stage ] -= mdeflate_ticks( ) : 0 )
+#define MDEFLATE_STAGE_END( ps, stage ) ( ( ps )->ps_stats != NULL ? ( ps )->ps_stats->rgi64_stage_ticks[ stage ] += mdeflate_ticks( ) : 0 )
+#else
+#define MDEFLATE_STAGE_START( ps, stage )
+#define MDEFLATE_STAGE_END( ps, stage )
+#endif
+#define MDEFLATE_BENCH_REPEATS 5
+#define MDEFLATE_BENCH_SIZE ( 4 << 20 ) /* bytes per synthetic input */
+
 
 /* ------------------------ COMPRESS ------------------------ */
 
 
+#if WITH_BENCH || WITH_STAGE_TIMERS
+
+/* time stamp counter cycles on x86, nanoseconds elsewhere */
+int64_t mdeflate_ticks( void )
+{
+#if defined( __x86_64__ ) || defined( __i386__ )
+	return ( int64_t )__rdtsc( );
+#else
+	struct timespec s_time;
+
+	clock_gettime( CLOCK_MONOTONIC, &s_time );
+	return ( int64_t )s_time.tv_sec * 1000000000 + s_time.tv_nsec;
+#endif
+}
+
+#endif
+
+
+/* MDEFLATE_CPU_* of the running cpu, the compiler runtime reads cpuid once at startup */
+int32_t mdeflate_cpu_features( void )
+{
+	int32_t i_features;
+
+	i_features = 0;
+#if MDEFLATE_DISPATCH
+	i_features |= __builtin_cpu_supports( "sse2" ) ? MDEFLATE_CPU_SSE2 : 0;
+	i_features |= __builtin_cpu_supports( "ssse3" ) ? MDEFLATE_CPU_SSSE3 : 0;
+	i_features |= __builtin_cpu_supports( "avx2" ) ? MDEFLATE_CPU_AVX2 : 0;
+	i_features |= __builtin_cpu_supports( "bmi2" ) ? MDEFLATE_CPU_BMI2 : 0;
+#endif
+	return i_features;
+}
+
+
+typedef struct {
+	int32_t i_strategy;
+	int32_t i_max_chain_depth;
+	int32_t i_nice_match_length;
+	int32_t i_lazy_match_length; /* matches at least this long are taken without looking ahead */
+	int32_t i_split_blocks; /* cut blocks where new huffman tables pay for their header */
+	int32_t i_reuse_tables; /* blocks may use the tables of the previous block and need to be decoded in order */
+	int32_t i_byte_literals; /* blocks may code literals as whole bytes, the decoder needs WITH_BYTE_LITERALS */
+	int32_t i_reset_blocks; /* if > 0 every i_reset_blocks block does not reference data before it */
+	int32_t i_window_log; /* window and block log are 0 for the legacy format without stream header */
+	int32_t i_block_log;
+} mdeflate_params_t;
+
+typedef struct {
+	int32_t i_window_log;
+	int32_t i_block_log;
+	int32_t i_window_size; /* largest match offset */
+	int32_t i_block_size; /* largest uncompressed block */
+	int32_t i_enc_block_bound;
+	int32_t i_length_bytes; /* size of the length in front of every block */
+	int32_t rgi_offset_extra[ MDEFLATE_MAX_OFFSET_NODES ];
+} mdeflate_format_t;
+
+/* filled by the context functions of the compressor and decompressor once set with mdeflate_set_stats or
+   minflate_set_stats. all fields are sums over the blocks, the caller clears the struct */
+typedef struct {
+	int64_t rgi64_blocks[ MDEFLATE_NUM_BLOCK_TYPES ]; /* per MDEFLATE_BLOCK_TYPE_* */
+	int64_t i64_uncompressed_bytes;
+	int64_t i64_compressed_bytes; /* without the block lengths */
+	int64_t i64_literals; /* including the bytes of stored blocks */
+	int64_t i64_matches;
+	int64_t i64_match_bytes;
+	int64_t rgi64_length_symbols[ MDEFLATE_MAX_LENGTH_NODES ]; /* match length and offset histograms by symbol, compressor only */
+	int64_t rgi64_offset_symbols[ MDEFLATE_MAX_OFFSET_NODES ];
+	int64_t i64_header_bits; /* block type and code lengths */
+	int64_t i64_payload_bits; /* symbols, extra bits and padding */
+	int64_t i64_limited_trees; /* written trees whose longest code hit the length limit, compressor only */
+	int64_t rgi64_stage_ticks[ MDEFLATE_NUM_STAGES ]; /* per MDEFLATE_STAGE_*, only with WITH_STAGE_TIMERS */
+} mdeflate_stats_t;
+
 typedef struct {
 	int32_t i_cw;
 	int32_t i_cw_length;
 	int32_t i_count;
-	int32_t i_order;
 } encnode_t;
 
-typedef struct treenode_s {
-	int32_t i_order;
+typedef struct {
+	encnode_t rgs_symbol_nodes[ MDEFLATE_MAX_SYMBOL_NODES ];
+	encnode_t rgs_literal_nodes[ MDEFLATE_MAX_LITERAL_NODES ];
+	encnode_t rgs_offset_nodes[ MDEFLATE_MAX_OFFSET_NODES ];
+	encnode_t rgs_byte_nodes[ MDEFLATE_MAX_BYTE_NODES ];
+	encnode_t rgs_bl_nodes[ MDEFLATE_MAX_BYTE_BL_NODES ];
+} mdeflate_tables_t;
+
+typedef struct {
 	int32_t i_count;
-	struct treenode_s *ps_parent;
-	struct treenode_s *rgps_children[ 2 ];
-} treenode_t;
+	int32_t i_node;
+} mdeflate_leaf_t;
 
 typedef struct {
+	uint32_t *pui_match_offset;
+	uint32_t *pui_price;
+	uint32_t *pui_step_offset;
+	uint32_t *pui_parse_offset;
+	uint16_t *pui16_match_count;
+	uint16_t *pui16_match_length;
+	uint16_t *pui16_step_length;
+	uint16_t *pui16_parse_length;
+
+	int32_t rgi_literal_price[ 256 ];
+	int32_t rgi_length_price[ MDEFLATE_MAX_MATCH_LENGTH ];
+	int32_t rgi_offset_price[ MDEFLATE_MAX_OFFSET_NODES ];
+} mdeflate_optimal_t;
+
+typedef struct mdeflate_compress_s {
 	int32_t i_max_codebook_back;
 	int32_t i_codebook_back;
 	int32_t i_max_match_length;
 	encnode_t rgs_symbol_nodes[ MDEFLATE_MAX_SYMBOL_NODES ];
-#if WITH_LITERAL_ONLY_TREE
 	encnode_t rgs_literal_nodes[ MDEFLATE_MAX_LITERAL_NODES ];
-#endif
 	encnode_t rgs_offset_nodes[ MDEFLATE_MAX_OFFSET_NODES ];
-	encnode_t rgs_bl_nodes[ MDEFLATE_MAX_BL_NODES ];
-	int32_t i_treenode_alloc;
-	treenode_t s_headnode;
-	treenode_t rgs_treenodes[ 64 * 2 ];
+	encnode_t rgs_byte_nodes[ MDEFLATE_MAX_BYTE_NODES ];
+	encnode_t rgs_bl_nodes[ MDEFLATE_MAX_BYTE_BL_NODES ];
 	int32_t i_max_depth;
+	int32_t i_tree_layout; /* MDEFLATE_TREE_* of the block being written */
 
-	int32_t i_num_overflow;
-	int32_t rgi_cw_length_counts[ MDEFLATE_MAX_CW_LENGTH + 1 ];
+	int32_t i_have_tables; /* the decoder knows the tables of the last huffman block */
+	int32_t i_reused_tables; /* the last written block reused them */
+	int32_t i_prev_tree_layout;
+	encnode_t rgs_prev_symbol_nodes[ MDEFLATE_MAX_SYMBOL_NODES ];
+	encnode_t rgs_prev_literal_nodes[ MDEFLATE_MAX_LITERAL_NODES ];
+	encnode_t rgs_prev_offset_nodes[ MDEFLATE_MAX_OFFSET_NODES ];
+	encnode_t rgs_prev_byte_nodes[ MDEFLATE_MAX_BYTE_NODES ];
 
 	int32_t i_symbol_count;
-	uint8_t rgui8_symbols[ MDEFLATE_BLOCK_SIZE + 1 ];
+	uint8_t *pui8_symbols;
 	int32_t i_length_and_offset_count;
-	int32_t rgi_length_and_offset[ MDEFLATE_BLOCK_SIZE + 1 ];
+	int32_t *pi_length_and_offset;
 
-	uint32_t ui_cw;
+	uint64_t ui64_cw;
 	int32_t i_cw_bits;
 	int32_t i_bitstream_size;
 	uint8_t *pui8_bitstream;
 
-	uint8_t rgui8_offset_lut[ MDEFLATE_MAX_CODEBOOK_BACK ];
-	uint32_t rgui_offset_offset[ MDEFLATE_MAX_CODEBOOK_BACK ];
+	uint8_t *pui8_offset_lut;
+	uint32_t rgui_offset_offset[ MDEFLATE_MAX_OFFSET_NODES ];
 	uint8_t rgui8_length_lut[ MDEFLATE_MAX_MATCH_LENGTH ];
 	uint32_t rgui_length_offset[ MDEFLATE_MAX_MATCH_LENGTH ];
+
+	mdeflate_params_t s_params;
+	mdeflate_format_t s_format;
+	uint8_t *pui8_window;
+	int32_t i_min_match_pos; /* matches may not start before this window position */
+	int32_t i_hash_pos;
+	uint32_t rgui_hash_head[ MDEFLATE_HASH_SIZE ];
+	uint32_t *pui_hash_chain;
+	int32_t i_hash_chain_size;
+	uint8_t *pui8_hash_end; /* end of the last parsed block, a block starting here continues its hash chains */
+
+	uint8_t *pui8_dict; /* preset dictionary followed by the message, see mdeflate_set_dict */
+	int32_t i_dict_length;
+	int32_t i_dict_hash_pos; /* the hash chains hold the dictionary up to here, 0 once other data overwrote them */
+	uint32_t *pui_dict_hash_head;
+
+	int32_t i_length_literal;
+	int32_t i_length_bcopy;
+	mdeflate_optimal_t *ps_optimal;
+
+	mdeflate_stats_t *ps_stats;
+	int32_t ( *pf_match_length )( uint8_t *pui8_a, uint8_t *pui8_b, int32_t i_length, int32_t i_max_length );
+	int32_t i_header_bits; /* of the block written last */
+	int32_t rgi_block_symbol_counts[ MDEFLATE_MAX_SYMBOL_NODES ]; /* before the trees are built, which may touch them */
+	int32_t rgi_block_offset_counts[ MDEFLATE_MAX_OFFSET_NODES ];
 } mdeflate_compress_t;
 
 const int32_t rgi_length_extra[ MDEFLATE_MAX_LENGTH_NODES ] = { 0, 1, 2, 3, 4, 5, 6, 7 };
-const int32_t rgi_offset_extra[ MDEFLATE_MAX_OFFSET_NODES ] = { 0, 1, 2, 4, 6, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 };
+const int32_t rgi_offset_extra[ MDEFLATE_MAX_OFFSET_NODES ] = { 0, 1, 2, 4, 6, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8, 8 }; /* legacy format */
+
+const int32_t rgi_log2_fraction[ 64 ] = {
+	0, 6, 11, 17, 22, 28, 33, 38, 44, 49, 54, 59, 63, 68, 73, 78, 82, 87, 92, 96, 100, 105, 109, 113, 118, 122, 126, 130, 134, 138, 142, 146,
+	150, 154, 157, 161, 165, 169, 172, 176, 179, 183, 186, 190, 193, 197, 200, 203, 207, 210, 213, 216, 220, 223, 226, 229, 232, 235, 238, 241, 244, 247, 250, 253
+}; /* log2( 1 + i / 64 ) in 1/256 bits */
+
+/* no byte literals, which decoders built without WITH_BYTE_LITERALS can not read, no reset points and the legacy
+   format by default */
+const mdeflate_params_t rgs_level_params[ MDEFLATE_MAX_LEVEL + 1 ] = {
+	{ MDEFLATE_STRATEGY_STORE,        0,   0,   0, 0, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_GREEDY,       4,  16,   0, 0, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_GREEDY,      16,  32,   0, 0, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_LAZY,        16,  32,  16, 0, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_LAZY,        64,  64,  64, 0, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_LAZY,       256, 128, MDEFLATE_MAX_MATCH_LENGTH, 1, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_DEEP_LAZY,  256, 128, MDEFLATE_MAX_MATCH_LENGTH, 1, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_DEEP_LAZY, 1024, 256, MDEFLATE_MAX_MATCH_LENGTH, 1, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_OPTIMAL,    256, 128,   0, 1, 1, 0, 0, 0, 0 },
+	{ MDEFLATE_STRATEGY_OPTIMAL,   1024, 256,   0, 1, 1, 0, 0, 0, 0 }
+};
+
+
+void mdeflate_write_be( uint8_t *pui8_out, uint64_t ui64_value, int32_t i_bytes )
+{
+	while( i_bytes-- > 0 )
+	{
+		pui8_out[ i_bytes ] = ui64_value & 0xff;
+		ui64_value >>= 8;
+	}
+}
+
+
+uint64_t mdeflate_read_be( uint8_t *pui8_in, int32_t i_bytes )
+{
+	uint64_t ui64_value = 0;
+
+	while( i_bytes-- > 0 )
+	{
+		ui64_value = ( ui64_value << 8 ) | *( pui8_in++ );
+	}
+	return ui64_value;
+}
+
+
+/* the first offset symbols keep the legacy extra bits, the following ones get one more extra bit every i_step symbols */
+int32_t mdeflate_fill_offset_extra( int32_t *pi_offset_extra, int32_t i_step )
+{
+	int32_t i_idx, i_coverage;
+
+	i_coverage = 0;
+	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+	{
+		pi_offset_extra[ i_idx ] = rgi_offset_extra[ i_idx ];
+		if( i_idx >= MDEFLATE_OFFSET_EXTRA_PREFIX )
+		{
+			pi_offset_extra[ i_idx ] += ( i_idx - MDEFLATE_OFFSET_EXTRA_PREFIX ) / i_step;
+			if( pi_offset_extra[ i_idx ] > MDEFLATE_MAX_OFFSET_EXTRA )
+			{
+				pi_offset_extra[ i_idx ] = MDEFLATE_MAX_OFFSET_EXTRA;
+			}
+		}
+		i_coverage += 1 << pi_offset_extra[ i_idx ];
+	}
+	return i_coverage;
+}
+
+
+int32_t mdeflate_clamp_log( int32_t i_log, int32_t i_default )
+{
+	if( i_log == 0 )
+	{
+		return i_default;
+	}
+	return i_log < MDEFLATE_MIN_LOG ? MDEFLATE_MIN_LOG : ( i_log > MDEFLATE_MAX_LOG ? MDEFLATE_MAX_LOG : i_log );
+}
+
+
+/* both logs 0 select the legacy format, otherwise the offset table is generated with the finest steps that still cover the window */
+void mdeflate_init_format( mdeflate_format_t *ps_format, int32_t i_window_log, int32_t i_block_log )
+{
+	int32_t i_step;
+
+	memset( ps_format, 0, sizeof( mdeflate_format_t ) );
+	i_step = MDEFLATE_MAX_OFFSET_NODES - MDEFLATE_OFFSET_EXTRA_PREFIX;
+	if( i_window_log == 0 && i_block_log == 0 )
+	{
+		ps_format->i_window_size = mdeflate_fill_offset_extra( ps_format->rgi_offset_extra, i_step ) - 1;
+		ps_format->i_block_size = MDEFLATE_BLOCK_SIZE / 2;
+		ps_format->i_enc_block_bound = MDEFLATE_MAX_ENC_BLOCK_SIZE;
+		ps_format->i_length_bytes = 2;
+		return;
+	}
+
+	ps_format->i_window_log = mdeflate_clamp_log( i_window_log, MDEFLATE_DEFAULT_WINDOW_LOG );
+	ps_format->i_block_log = mdeflate_clamp_log( i_block_log, MDEFLATE_DEFAULT_BLOCK_LOG );
+	ps_format->i_window_size = 1 << ps_format->i_window_log;
+	ps_format->i_block_size = 1 << ps_format->i_block_log;
+	ps_format->i_enc_block_bound = MDEFLATE_ENC_BLOCK_BOUND( ps_format->i_block_size );
+	ps_format->i_length_bytes = 4;
+	while( mdeflate_fill_offset_extra( ps_format->rgi_offset_extra, i_step ) < ps_format->i_window_size && i_step > 1 )
+	{
+		i_step--;
+	}
+}
+
+
+/* the header is 'M' 'D' window log block log, the legacy format has none. a legacy stream can not start with 'M' 'D' as
+   that block length is larger than MDEFLATE_MAX_ENC_BLOCK_SIZE */
+int32_t mdeflate_write_header( const mdeflate_format_t *ps_format, uint8_t *pui8_out )
+{
+	if( ps_format->i_window_log == 0 )
+	{
+		return 0;
+	}
+	pui8_out[ 0 ] = 'M';
+	pui8_out[ 1 ] = 'D';
+	pui8_out[ 2 ] = ( uint8_t )ps_format->i_window_log;
+	pui8_out[ 3 ] = ( uint8_t )ps_format->i_block_log;
+	return MDEFLATE_HEADER_SIZE;
+}
+
+
+int32_t mdeflate_write_terminator( const mdeflate_format_t *ps_format, uint8_t *pui8_out )
+{
+	mdeflate_write_be( pui8_out, 0, ps_format->i_length_bytes );
+	return ps_format->i_length_bytes;
+}
+
 
+void mdeflate_store_be32( uint8_t *pui8_data, uint32_t ui_value )
+{
+#if defined( __GNUC__ ) && defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	ui_value = __builtin_bswap32( ui_value );
+	memcpy( pui8_data, &ui_value, sizeof( ui_value ) );
+#elif defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	memcpy( pui8_data, &ui_value, sizeof( ui_value ) );
+#else
+	pui8_data[ 0 ] = ui_value >> 24;
+	pui8_data[ 1 ] = ui_value >> 16;
+	pui8_data[ 2 ] = ui_value >> 8;
+	pui8_data[ 3 ] = ui_value;
+#endif
+}
 
-void mdeflate_write_bits( mdeflate_compress_t *ps_compress, int32_t i_cw, int32_t i_cw_length )
+
+/* the codeword bits are shifted in at the bottom of the 64 bit register and leave it as whole 32 bit words,
+   i_cw_length can be up to 32 and i_cw must not have bits set above it */
+void mdeflate_write_bits( mdeflate_compress_t *ps_compress, uint32_t ui_cw, int32_t i_cw_length )
 {
-	ps_compress->ui_cw |= i_cw << ( 32 - i_cw_length - ps_compress->i_cw_bits );
+	ps_compress->ui64_cw = ( ps_compress->ui64_cw << i_cw_length ) | ui_cw;
 	ps_compress->i_cw_bits += i_cw_length;
 
+	if( ps_compress->i_cw_bits >= 32 )
+	{
+		ps_compress->i_cw_bits -= 32;
+		mdeflate_store_be32( ps_compress->pui8_bitstream + ps_compress->i_bitstream_size, ( uint32_t )( ps_compress->ui64_cw >> ps_compress->i_cw_bits ) );
+		ps_compress->i_bitstream_size += 4;
+	}
+}
+
+
+void mdeflate_flush_bits( mdeflate_compress_t *ps_compress )
+{
 	while( ps_compress->i_cw_bits >= 8 )
 	{
-		ps_compress->pui8_bitstream[ ps_compress->i_bitstream_size++ ] = ps_compress->ui_cw >> 24;
-		ps_compress->ui_cw <<= 8;
 		ps_compress->i_cw_bits -= 8;
+		ps_compress->pui8_bitstream[ ps_compress->i_bitstream_size++ ] = ( uint8_t )( ps_compress->ui64_cw >> ps_compress->i_cw_bits );
+	}
+	if( ps_compress->i_cw_bits > 0 )
+	{
+		ps_compress->pui8_bitstream[ ps_compress->i_bitstream_size++ ] = ( uint8_t )( ps_compress->ui64_cw << ( 8 - ps_compress->i_cw_bits ) );
+		ps_compress->i_cw_bits = 0;
 	}
 }
 
@@ -131,10 +549,10 @@ void mdeflate_init_length_and_offset_table( mdeflate_compress_t *ps_compress )
 	for( i_offset_symbol_idx = 0; i_offset_symbol_idx < MDEFLATE_MAX_OFFSET_NODES; i_offset_symbol_idx++ )
 	{
 		ps_compress->rgui_offset_offset[ i_offset_symbol_idx ] = i_offset;
-		i_offset_size = 1 << rgi_offset_extra[ i_offset_symbol_idx ];
-		for( i_idx = 0; i_idx < i_offset_size; i_idx++ )
+		i_offset_size = 1 << ps_compress->s_format.rgi_offset_extra[ i_offset_symbol_idx ];
+		for( i_idx = 0; i_idx < i_offset_size && i_offset < ps_compress->s_format.i_window_size; i_idx++ )
 		{
-			ps_compress->rgui8_offset_lut[ i_offset++ ] = i_offset_symbol_idx;
+			ps_compress->pui8_offset_lut[ i_offset++ ] = i_offset_symbol_idx;
 		}
 	}
 
@@ -149,7 +567,7 @@ void mdeflate_init_length_and_offset_table( mdeflate_compress_t *ps_compress )
 		}
 	}
 
-	ps_compress->i_max_codebook_back = i_offset - 1;
+	ps_compress->i_max_codebook_back = ps_compress->s_format.i_window_size;
 	ps_compress->i_max_match_length = i_length - 1;
 #if MDEFLATE_DEBUG_PRINTF > 0
 	printf("max codebook back: %d, max match length: %d\n", ps_compress->i_max_codebook_back, ps_compress->i_max_match_length );
@@ -157,55 +575,43 @@ void mdeflate_init_length_and_offset_table( mdeflate_compress_t *ps_compress )
 }
 
 
-void mdeflate_assign_cw_r( mdeflate_compress_t *ps_compress, treenode_t *ps_treenode, int32_t i_depth )
+int mdeflate_compare_leaves( const void *pv_a, const void *pv_b )
 {
-	if( i_depth > ps_compress->i_max_depth )
-	{
-		ps_compress->i_num_overflow++;
-	}
+	const mdeflate_leaf_t *ps_a = pv_a, *ps_b = pv_b;
 
-	if( ps_treenode->i_order >= 0 )
-	{
-		if( i_depth > ps_compress->i_max_depth )
-		{
-			ps_compress->rgi_cw_length_counts[ ps_compress->i_max_depth ]++;
-		}
-		else
-		{
-			ps_compress->rgi_cw_length_counts[ i_depth ]++;
-		}
-	}
-	else
+	if( ps_a->i_count != ps_b->i_count )
 	{
-		mdeflate_assign_cw_r( ps_compress, ps_treenode->rgps_children[ 0 ], i_depth + 1 );
-		mdeflate_assign_cw_r( ps_compress, ps_treenode->rgps_children[ 1 ], i_depth + 1 );
+		return ps_a->i_count < ps_b->i_count ? -1 : 1;
 	}
+	return ps_a->i_node - ps_b->i_node;
 }
 
-int32_t mdeflate_construct_tree( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes, int32_t i_num_nodes, int32_t i_max_cw_length )
+
+/* package-merge: list 0 holds the leaves sorted by count, every following list merges the leaves with the
+   pairs of the list before. the first 2n-2 items of the last list give the optimal length limited code, a leaf
+   gets one bit for every list it is part of the selection in. returns the number of coded nodes or -1 */
+int32_t mdeflate_package_merge( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes, int32_t i_num_nodes, int32_t i_max_cw_length )
 {
-	int32_t i_node, i_non_zero, i_last_non_zero, i_highest, i_highest_count, i_order_zero, i_idx, i_osearch, i_order;
+	int32_t i_node, i_non_zero, i_last_non_zero, i_max_items, i_list, i_item, i_leaf, i_package, i_num_packages, i_select, i_num_leaves;
+	int32_t rgi_list_length[ MDEFLATE_MAX_BYTE_CW_LENGTH ];
+	int32_t rgi_weight[ MDEFLATE_MAX_BYTE_CW_LENGTH ][ 2 * MDEFLATE_MAX_TREE_NODES ];
+	uint8_t rgui8_is_leaf[ MDEFLATE_MAX_BYTE_CW_LENGTH ][ 2 * MDEFLATE_MAX_TREE_NODES ];
+	mdeflate_leaf_t rgs_leaves[ MDEFLATE_MAX_TREE_NODES ];
+
+	ps_compress->i_max_depth = i_max_cw_length;
 
 	i_non_zero = 0;
+	i_last_non_zero = 0;
 	for( i_node = 0; i_node < i_num_nodes; i_node++ )
 	{
 		ps_nodes[ i_node ].i_cw = 0;
 		ps_nodes[ i_node ].i_cw_length = 0;
-		ps_nodes[ i_node ].i_order = -1;
 		if( ps_nodes[ i_node ].i_count > 0 )
 		{
 			i_non_zero++;
 			i_last_non_zero = i_node;
 		}
 	}
-	for( i_idx = 0; i_idx <= ps_compress->i_max_depth; i_idx++ )
-	{
-		ps_compress->rgi_cw_length_counts[ i_idx ] = 0;
-	}
-
-	memset( ps_compress->rgs_treenodes, 0, sizeof( ps_compress->rgs_treenodes ) );
-	
-	ps_compress->i_max_depth = i_max_cw_length;
 
 	if( i_non_zero == 0 )
 	{
@@ -224,137 +630,91 @@ int32_t mdeflate_construct_tree( mdeflate_compress_t *ps_compress, encnode_t *ps
 		}
 		i_non_zero++;
 	}
-	
-	for( i_idx = 0; i_idx < i_non_zero; i_idx++ )
+
+	if( i_num_nodes > MDEFLATE_MAX_TREE_NODES || i_max_cw_length > MDEFLATE_MAX_BYTE_CW_LENGTH || i_non_zero > ( 1 << i_max_cw_length ) )
 	{
-		i_highest = -1;
-		i_highest_count = 0;
-		for( i_node = 0; i_node < i_num_nodes; i_node++ )
-		{
-			if( ps_nodes[ i_node ].i_order < 0 && ps_nodes[ i_node ].i_count > i_highest_count )
-			{
-				i_highest_count = ps_nodes[ i_node ].i_count;
-				i_highest = i_node;
-			}
-		}
-		if( i_highest < 0 )
-		{
-			fprintf( stderr, "order sorting failure\n");
-			exit( -1 );
-		}
-		ps_nodes[ i_highest ].i_order = i_idx;
-		if( i_idx == 0 )
+		return -1;
+	}
+
+	i_leaf = 0;
+	for( i_node = 0; i_node < i_num_nodes; i_node++ )
+	{
+		if( ps_nodes[ i_node ].i_count > 0 )
 		{
-			i_order_zero = i_highest;
+			rgs_leaves[ i_leaf ].i_count = ps_nodes[ i_node ].i_count;
+			rgs_leaves[ i_leaf ].i_node = i_node;
+			i_leaf++;
 		}
 	}
+	qsort( rgs_leaves, i_non_zero, sizeof( rgs_leaves[ 0 ] ), mdeflate_compare_leaves );
 
-	ps_compress->s_headnode.rgps_children[ 0 ] = &ps_compress->rgs_treenodes[ 0 ];
-	ps_compress->s_headnode.rgps_children[ 1 ] = NULL;
-	ps_compress->rgs_treenodes[ 0 ].i_order = 0;
-	ps_compress->rgs_treenodes[ 0 ].i_count = ps_nodes[ i_order_zero ].i_count;
-	ps_compress->rgs_treenodes[ 0 ].ps_parent = &ps_compress->s_headnode;
-	ps_compress->i_treenode_alloc = 1;
+	i_max_items = 2 * i_non_zero - 2;
+	for( i_item = 0; i_item < i_non_zero; i_item++ )
+	{
+		rgi_weight[ 0 ][ i_item ] = rgs_leaves[ i_item ].i_count;
+		rgui8_is_leaf[ 0 ][ i_item ] = 1;
+	}
+	rgi_list_length[ 0 ] = i_non_zero;
 
-	for( i_idx = 1; i_idx < i_non_zero; i_idx++ )
+	for( i_list = 1; i_list < i_max_cw_length; i_list++ )
 	{
-		treenode_t *ps_treenode, *ps_new_branch, *ps_tree, *ps_parent;
-		for( i_node = 0; i_node < i_num_nodes; i_node++ )
+		i_leaf = i_package = i_item = 0;
+		i_num_packages = rgi_list_length[ i_list - 1 ] / 2;
+		while( i_item < i_max_items && ( i_leaf < i_non_zero || i_package < i_num_packages ) )
 		{
-			if( ps_nodes[ i_node ].i_order == i_idx )
+			if( i_package >= i_num_packages || ( i_leaf < i_non_zero && rgs_leaves[ i_leaf ].i_count <= rgi_weight[ i_list - 1 ][ i_package * 2 ] + rgi_weight[ i_list - 1 ][ i_package * 2 + 1 ] ) )
 			{
-				break;
+				rgi_weight[ i_list ][ i_item ] = rgs_leaves[ i_leaf++ ].i_count;
+				rgui8_is_leaf[ i_list ][ i_item ] = 1;
 			}
+			else
+			{
+				rgi_weight[ i_list ][ i_item ] = rgi_weight[ i_list - 1 ][ i_package * 2 ] + rgi_weight[ i_list - 1 ][ i_package * 2 + 1 ];
+				rgui8_is_leaf[ i_list ][ i_item ] = 0;
+				i_package++;
+			}
+			i_item++;
 		}
+		rgi_list_length[ i_list ] = i_item;
+	}
 
-		ps_treenode = &ps_compress->rgs_treenodes[ ps_compress->i_treenode_alloc++ ];
-		ps_new_branch = &ps_compress->rgs_treenodes[ ps_compress->i_treenode_alloc++ ];
-
-		ps_treenode->i_order = i_idx;
-		ps_treenode->i_count = ps_nodes[ i_node ].i_count;
-		ps_new_branch->i_order = -1;
-		ps_new_branch->rgps_children[ 1 ] = ps_treenode;
-		ps_treenode->ps_parent = ps_new_branch;
-
-		ps_tree = ps_compress->s_headnode.rgps_children[ 0 ];
-		while( ps_tree->i_order < 0 && ps_tree->i_count > ps_treenode->i_count )
-		{
-			ps_tree = ps_tree->rgps_children[ 1 ];
-		}
-		ps_new_branch->ps_parent = ps_tree->ps_parent;
-		ps_new_branch->rgps_children[ 0 ] = ps_tree;
-		ps_tree->ps_parent = ps_new_branch;
-
-		if( ps_new_branch->ps_parent->rgps_children[ 0 ] == ps_tree )
+	/* leaves in a list are in count order, so the selected ones are always the i_num_leaves lightest */
+	i_select = i_max_items;
+	for( i_list = i_max_cw_length - 1; i_list >= 0 && i_select > 0; i_list-- )
+	{
+		if( i_select > rgi_list_length[ i_list ] )
 		{
-			ps_new_branch->ps_parent->rgps_children[ 0 ] = ps_new_branch;
+			return -1;
 		}
-		else
+		i_num_leaves = 0;
+		for( i_item = 0; i_item < i_select; i_item++ )
 		{
-			ps_new_branch->ps_parent->rgps_children[ 1 ] = ps_new_branch;
+			i_num_leaves += rgui8_is_leaf[ i_list ][ i_item ];
 		}
-		ps_new_branch->i_count += ps_tree->i_count;
-		
-		ps_tree = ps_new_branch;
-		while( ps_tree->ps_parent != &ps_compress->s_headnode )
+		for( i_leaf = 0; i_leaf < i_num_leaves; i_leaf++ )
 		{
-			treenode_t *ps_swap;
-
-			ps_tree->i_count += ps_treenode->i_count;
-
-			ps_parent = ps_tree->ps_parent;
-			if( ps_parent->rgps_children[ 0 ]->i_count < ps_parent->rgps_children[ 1 ]->i_count )
-			{
-				ps_swap = ps_parent->rgps_children[ 0 ];
-				ps_parent->rgps_children[ 0 ] = ps_parent->rgps_children[ 1 ];
-				ps_parent->rgps_children[ 1 ] = ps_swap;
-			}
-			ps_tree = ps_parent;
+			ps_nodes[ rgs_leaves[ i_leaf ].i_node ].i_cw_length++;
 		}
+		i_select = ( i_select - i_num_leaves ) * 2;
 	}
 
-	mdeflate_assign_cw_r( ps_compress, ps_compress->s_headnode.rgps_children[ 0 ], 0 );
+	return i_non_zero;
+}
 
-	if( ps_compress->i_num_overflow != 0 )
-	{
-		while( ps_compress->i_num_overflow )
-		{
-			for( i_idx = ps_compress->i_max_depth - 1; i_idx > 0; i_idx-- )
-			{
-				if( ps_compress->rgi_cw_length_counts[ i_idx ] > 0 )
-				{
-					ps_compress->rgi_cw_length_counts[ i_idx ]--;
-					ps_compress->rgi_cw_length_counts[ i_idx + 1 ] += 2;
-					ps_compress->rgi_cw_length_counts[ ps_compress->i_max_depth ]--;
-					ps_compress->i_num_overflow -= 2;
-					break;
-				}
-			}
-		}
-	}
 
-	i_order = 0;
-	for( i_idx = 1; i_idx <= ps_compress->i_max_depth; i_idx++ )
-	{
-		for( i_node = 0; i_node < ps_compress->rgi_cw_length_counts[ i_idx ]; i_node++ )
-		{
-			for( i_osearch = 0; i_osearch < i_num_nodes; i_osearch++ )
-			{
-				if( ps_nodes[ i_osearch ].i_order == i_order )
-				{
-					ps_nodes[ i_osearch ].i_cw_length = i_idx;
-					i_order++;
-					break;
-				}
-			}
-		}
-	}
+int32_t mdeflate_construct_tree( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes, int32_t i_num_nodes, int32_t i_max_cw_length )
+{
+	int32_t i_non_zero;
+
+	MDEFLATE_STAGE_START( ps_compress, MDEFLATE_STAGE_TREE );
+	i_non_zero = mdeflate_package_merge( ps_compress, ps_nodes, i_num_nodes, i_max_cw_length );
+	MDEFLATE_STAGE_END( ps_compress, MDEFLATE_STAGE_TREE );
 	return i_non_zero;
 }
 
 
 
-void mdeflate_assign_cw( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes, int32_t i_num_nodes, treenode_t *ps_treenode )
+int32_t mdeflate_assign_cw( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes, int32_t i_num_nodes )
 {
 	int32_t i_cw_length, i_cw, i_node;
 
@@ -381,572 +741,4887 @@ void mdeflate_assign_cw( mdeflate_compress_t *ps_compress, encnode_t *ps_nodes,
 	}
 	if( i_cw != ( ( 1 << ps_compress->i_max_depth ) ) )
 	{
-		fprintf( stderr, "codeword assignment failure ! ( %d %d)\n", i_cw, 1 << ps_compress->i_max_depth );
-		exit( -1 );
+		return -1;
 	}
+	return 0;
 }
 
 
-int32_t mdeflate_find_match( mdeflate_compress_t *ps_compress, uint8_t *pui8_search, int32_t i_offset_from_start, int32_t i_search_end, int32_t *pi_offset )
+uint32_t mdeflate_hash( uint8_t *pui8_data )
 {
-	int32_t i_max_match_length, i_max_back, i_offset, i_best_offset, i_best_match_length, i_match;
+	uint32_t ui_key;
 
+	ui_key = ( pui8_data[ 0 ] << 16 ) | ( pui8_data[ 1 ] << 8 ) | pui8_data[ 2 ];
+	return ( ui_key * 2654435761U ) >> ( 32 - MDEFLATE_HASH_BITS );
+}
 
-	i_max_match_length = i_search_end - i_offset_from_start;
-	if( i_max_match_length > ps_compress->i_max_match_length )
+
+void mdeflate_hash_insert_to( mdeflate_compress_t *ps_compress, int32_t i_pos )
+{
+	uint32_t ui_hash;
+
+	while( ps_compress->i_hash_pos < i_pos )
 	{
-		i_max_match_length = ps_compress->i_max_match_length;
+		ui_hash = mdeflate_hash( &ps_compress->pui8_window[ ps_compress->i_hash_pos ] );
+		ps_compress->pui_hash_chain[ ps_compress->i_hash_pos ] = ps_compress->rgui_hash_head[ ui_hash ];
+		ps_compress->rgui_hash_head[ ui_hash ] = ps_compress->i_hash_pos + 1; /* 0 terminates the chain */
+		ps_compress->i_hash_pos++;
 	}
-	i_max_back = i_offset_from_start + ps_compress->i_codebook_back;
-	if( i_max_back > ps_compress->i_max_codebook_back )
+}
+
+
+/* moves the window start i_shift bytes up and drops the chain positions before it */
+void mdeflate_slide_hash( mdeflate_compress_t *ps_compress, int32_t i_shift )
+{
+	int32_t i_idx;
+	uint32_t ui_shift = ( uint32_t )i_shift;
+
+	for( i_idx = 0; i_idx < MDEFLATE_HASH_SIZE; i_idx++ )
 	{
-		i_max_back = ps_compress->i_max_codebook_back;
+		ps_compress->rgui_hash_head[ i_idx ] = ps_compress->rgui_hash_head[ i_idx ] > ui_shift ? ps_compress->rgui_hash_head[ i_idx ] - ui_shift : 0;
 	}
-	i_offset = 1;
-	
-	i_best_offset = i_best_match_length = 0;
-	*pi_offset = 0;
-	
-	while( i_offset < i_max_back )
+	for( i_idx = i_shift; i_idx < ps_compress->i_hash_pos; i_idx++ )
 	{
-		i_match = 0;
-		if( pui8_search[ -i_offset ] == pui8_search[ 0 ] && pui8_search[ -i_offset + i_best_match_length ] == pui8_search[ i_best_match_length ] )
-		{
-			i_match = 1;
-			while( pui8_search[ -i_offset + i_match ] == pui8_search[ i_match ] && i_match < i_max_match_length )
-			{
-				i_match++;
-			}	
-		}
-		if( i_match > i_best_match_length )
-		{
-			i_best_match_length = i_match;
-			i_best_offset = i_offset;
-		}
-		i_offset++;
+		ps_compress->pui_hash_chain[ i_idx - i_shift ] = ps_compress->pui_hash_chain[ i_idx ] > ui_shift ? ps_compress->pui_hash_chain[ i_idx ] - ui_shift : 0;
 	}
+	ps_compress->i_hash_pos = ps_compress->i_hash_pos > i_shift ? ps_compress->i_hash_pos - i_shift : 0;
+	ps_compress->pui8_window += i_shift;
+}
+
+
+/* extends a common prefix of i_length bytes of pui8_a and pui8_b up to i_max_length, 8 bytes at a time with the
+   xor of two loads. never reads past i_max_length */
+int32_t mdeflate_match_length( uint8_t *pui8_a, uint8_t *pui8_b, int32_t i_length, int32_t i_max_length )
+{
+#if defined( __GNUC__ ) && defined( __BYTE_ORDER__ )
+	uint64_t ui64_a, ui64_b;
 
-	if( i_best_match_length == MDEFLATE_MATCH_LENGTH_OFFSET ) /* sanity */
+	while( i_length + 8 <= i_max_length )
 	{
-		int32_t i_offset_symbol, i_offset_size;
-		i_offset_symbol = ps_compress->rgui8_offset_lut[ i_offset - 1 ];
-		i_offset_size = rgi_offset_extra[ i_offset_symbol ];
-		if( ( i_offset_size + 14 ) > ( i_best_match_length * 8 ) )
+		memcpy( &ui64_a, pui8_a + i_length, sizeof( ui64_a ) );
+		memcpy( &ui64_b, pui8_b + i_length, sizeof( ui64_b ) );
+		if( ui64_a != ui64_b )
 		{
-			i_best_match_length = 0;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return i_length + ( __builtin_ctzll( ui64_a ^ ui64_b ) >> 3 );
+#else
+			return i_length + ( __builtin_clzll( ui64_a ^ ui64_b ) >> 3 );
+#endif
 		}
+		i_length += 8;
 	}
-
-	if( i_best_match_length >= MDEFLATE_MATCH_LENGTH_OFFSET )
+#endif
+	while( i_length < i_max_length && pui8_a[ i_length ] == pui8_b[ i_length ] )
 	{
-		*pi_offset = i_best_offset;
-		return i_best_match_length;
+		i_length++;
 	}
-	return 0;
+	return i_length;
 }
 
+#if MDEFLATE_DISPATCH
 
-int32_t mdeflate_enc_block( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back )
+/* 16 and 32 bytes per step, the tail goes to mdeflate_match_length */
+MDEFLATE_TARGET( "sse2" ) int32_t mdeflate_match_length_sse2( uint8_t *pui8_a, uint8_t *pui8_b, int32_t i_length, int32_t i_max_length )
 {
-	int32_t i_idx, i_length_and_offset_idx, i_length_literal, i_length_bcopy, i_next_match_length, i_next_offset;
-	
-	mdeflate_compress_t s_compress;
+	uint32_t ui_mask;
 
-	memset( &s_compress, 0, sizeof( s_compress ) );
+	while( i_length + 16 <= i_max_length )
+	{
+		ui_mask = ~( uint32_t )_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( ( __m128i * )( pui8_a + i_length ) ), _mm_loadu_si128( ( __m128i * )( pui8_b + i_length ) ) ) ) & 0xffff;
+		if( ui_mask != 0 )
+		{
+			return i_length + __builtin_ctz( ui_mask );
+		}
+		i_length += 16;
+	}
+	return mdeflate_match_length( pui8_a, pui8_b, i_length, i_max_length );
+}
 
-	s_compress.pui8_bitstream = pui8_out_data;
-	mdeflate_init_length_and_offset_table( &s_compress );
-	s_compress.i_codebook_back = i_cb_back;
 
-	i_length_literal = i_length_bcopy = 0;
+MDEFLATE_TARGET( "avx2" ) int32_t mdeflate_match_length_avx2( uint8_t *pui8_a, uint8_t *pui8_b, int32_t i_length, int32_t i_max_length )
+{
+	uint32_t ui_mask;
 
-	i_next_match_length = -1;
-	for( i_idx = 0; i_idx < i_in_data_length; )
+	while( i_length + 32 <= i_max_length )
 	{
-		int32_t i_symbol, i_offset_symbol, i_length, i_offset;
-
-		if( i_next_match_length < 0 )
-		{
-			i_length = mdeflate_find_match( &s_compress, &pui8_in_data[ i_idx ], i_idx, i_in_data_length, &i_offset );
-			if( i_length > 0 && ( i_idx + 1 ) < i_in_data_length )
-			{
-				i_next_match_length = mdeflate_find_match( &s_compress, &pui8_in_data[ i_idx + 1 ], i_idx + 1, i_in_data_length, &i_next_offset );
-			}
-			if( i_next_match_length > i_length )
-			{
-				i_length = 0;
-			}
-			else
-			{
-				i_next_match_length = -1;
-			}
-		}
-		else
+		ui_mask = ~( uint32_t )_mm256_movemask_epi8( _mm256_cmpeq_epi8( _mm256_loadu_si256( ( __m256i * )( pui8_a + i_length ) ), _mm256_loadu_si256( ( __m256i * )( pui8_b + i_length ) ) ) );
+		if( ui_mask != 0 )
 		{
-			i_length = i_next_match_length;
-			i_offset = i_next_offset;
-			i_next_match_length = -1;
+			return i_length + __builtin_ctz( ui_mask );
 		}
-		if( i_length > 0 )
-		{
-			i_idx += i_length;
-			i_length_bcopy += i_length;
+		i_length += 32;
+	}
+	return mdeflate_match_length( pui8_a, pui8_b, i_length, i_max_length );
+}
 
-#if MDEFLATE_DEBUG_PRINTF > 1
-			printf("match %d %d\n", i_length, i_offset );
 #endif
 
-			i_length -= MDEFLATE_MATCH_LENGTH_OFFSET;
-			i_symbol = s_compress.rgui8_length_lut[ i_length ];
-			i_length -= s_compress.rgui_length_offset[ i_symbol ];
-			i_symbol += MDEFLATE_LENGTH_NODES_OFFSET;
 
-			i_offset -= 1;
-			i_offset_symbol = s_compress.rgui8_offset_lut[ i_offset ];
-			i_offset -= s_compress.rgui_offset_offset[ i_offset_symbol ];
-			
-			s_compress.rgs_symbol_nodes[ i_symbol ].i_count++;
-			s_compress.rgui8_symbols[ s_compress.i_symbol_count++ ] = i_symbol;
+/* true if the two bytes at i_idx - 1 and the first two bytes of both are equal */
+int32_t mdeflate_match_candidate( uint8_t *pui8_a, uint8_t *pui8_b, int32_t i_idx )
+{
+	uint16_t ui16_a_end, ui16_b_end, ui16_a, ui16_b;
 
-			s_compress.rgs_offset_nodes[ i_offset_symbol ].i_count++;
-			s_compress.rgui8_symbols[ s_compress.i_symbol_count++ ] = i_offset_symbol;
-			s_compress.rgi_length_and_offset[ s_compress.i_length_and_offset_count++ ] = i_length;
-			s_compress.rgi_length_and_offset[ s_compress.i_length_and_offset_count++ ] = i_offset;			
-		}
-		else
-		{
-			i_symbol = pui8_in_data[ i_idx ] & 0xf;
-			s_compress.rgs_symbol_nodes[ i_symbol ].i_count++;
-			s_compress.rgui8_symbols[ s_compress.i_symbol_count++ ] = i_symbol;
+	memcpy( &ui16_a_end, pui8_a + i_idx - 1, sizeof( ui16_a_end ) );
+	memcpy( &ui16_b_end, pui8_b + i_idx - 1, sizeof( ui16_b_end ) );
+	memcpy( &ui16_a, pui8_a, sizeof( ui16_a ) );
+	memcpy( &ui16_b, pui8_b, sizeof( ui16_b ) );
+	return ui16_a_end == ui16_b_end && ui16_a == ui16_b;
+}
 
-			i_symbol = ( pui8_in_data[ i_idx ] >> 4 ) & 0xf;
-#if !WITH_LITERAL_ONLY_TREE
-			s_compress.rgs_symbol_nodes[ i_symbol ].i_count++;
-#else
-			s_compress.rgs_literal_nodes[ i_symbol ].i_count++;
-#endif
-			s_compress.rgui8_symbols[ s_compress.i_symbol_count++ ] = i_symbol;
 
-			i_idx += 1;
-			i_length_literal += 1;
-		}
-	}
-	s_compress.rgs_symbol_nodes[ MDEFLATE_END_OF_BLOCK_NODE ].i_count++;
-	s_compress.rgui8_symbols[ s_compress.i_symbol_count++ ] = MDEFLATE_END_OF_BLOCK_NODE;
+int32_t mdeflate_find_matches( mdeflate_compress_t *ps_compress, int32_t i_pos, int32_t i_search_end, uint16_t *pui16_lengths, uint32_t *pui_offsets, int32_t i_max_matches )
+{
+	int32_t i_max_match_length, i_min_pos, i_chain, i_depth, i_best_match_length, i_match, i_num_matches;
+	uint8_t *pui8_search, *pui8_candidate;
 
-	mdeflate_construct_tree( &s_compress, &s_compress.rgs_symbol_nodes[ 0 ], MDEFLATE_MAX_SYMBOL_NODES, MDEFLATE_MAX_CW_LENGTH );
-	mdeflate_assign_cw( &s_compress, &s_compress.rgs_symbol_nodes[ 0 ], MDEFLATE_MAX_SYMBOL_NODES, s_compress.s_headnode.rgps_children[ 0 ] );
-#if WITH_LITERAL_ONLY_TREE
-	if( mdeflate_construct_tree( &s_compress, &s_compress.rgs_literal_nodes[ 0 ], MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_CW_LENGTH ) )
+	i_max_match_length = i_search_end - i_pos;
+	if( i_max_match_length > ps_compress->i_max_match_length )
 	{
-		mdeflate_assign_cw( &s_compress, &s_compress.rgs_literal_nodes[ 0 ], MDEFLATE_MAX_LITERAL_NODES, s_compress.s_headnode.rgps_children[ 0 ] );
+		i_max_match_length = ps_compress->i_max_match_length;
 	}
-#endif
-	if( mdeflate_construct_tree( &s_compress, &s_compress.rgs_offset_nodes[ 0 ], MDEFLATE_MAX_OFFSET_NODES, MDEFLATE_MAX_CW_LENGTH ) )
-	{
-		mdeflate_assign_cw( &s_compress, &s_compress.rgs_offset_nodes[ 0 ], MDEFLATE_MAX_OFFSET_NODES, s_compress.s_headnode.rgps_children[ 0 ] );
-	}
-
-
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
-	{
-		s_compress.rgs_bl_nodes[ s_compress.rgs_symbol_nodes[ i_idx ].i_cw_length ].i_count++;
-	}
-#if WITH_LITERAL_ONLY_TREE
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_LITERAL_NODES; i_idx++ )
-	{
-		s_compress.rgs_bl_nodes[ s_compress.rgs_literal_nodes[ i_idx ].i_cw_length ].i_count++;
-	}
-#endif
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+	if( i_max_match_length < MDEFLATE_MATCH_LENGTH_OFFSET )
 	{
-		s_compress.rgs_bl_nodes[ s_compress.rgs_offset_nodes[ i_idx ].i_cw_length ].i_count++;
+		return 0;
 	}
-
-	mdeflate_construct_tree( &s_compress, &s_compress.rgs_bl_nodes[ 0 ], MDEFLATE_MAX_BL_NODES, MDEFLATE_MAX_BL_CW_LENGTH );
-	mdeflate_assign_cw( &s_compress, &s_compress.rgs_bl_nodes[ 0 ], MDEFLATE_MAX_BL_NODES, s_compress.s_headnode.rgps_children[ 0 ] );
-
-	
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_BL_NODES; i_idx++ )
+	i_min_pos = i_pos - ps_compress->i_max_codebook_back;
+	if( i_min_pos < ps_compress->i_min_match_pos )
 	{
-		mdeflate_write_bits( &s_compress, s_compress.rgs_bl_nodes[ i_idx ].i_cw_length, 3 );
+		i_min_pos = ps_compress->i_min_match_pos;
 	}
-	
 
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
-	{
-		int32_t i_bl_idx = s_compress.rgs_symbol_nodes[ i_idx ].i_cw_length;
-		mdeflate_write_bits( &s_compress, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw_length );
-	}
-#if WITH_LITERAL_ONLY_TREE
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_LITERAL_NODES; i_idx++ )
-	{
-		int32_t i_bl_idx = s_compress.rgs_literal_nodes[ i_idx ].i_cw_length;
-		mdeflate_write_bits( &s_compress, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw_length );
-	}
-#endif
-	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
-	{
-		int32_t i_bl_idx = s_compress.rgs_offset_nodes[ i_idx ].i_cw_length;
-		mdeflate_write_bits( &s_compress, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw, s_compress.rgs_bl_nodes[ i_bl_idx ].i_cw_length );
-	}
+	mdeflate_hash_insert_to( ps_compress, i_pos );
 
-#if MDEFLATE_DEBUG_PRINTF > 0
-	printf( "stats: literal: %db, bcopy: %db, tot: %d\n", i_length_literal, i_length_bcopy, i_length_literal + i_length_bcopy );
-#endif
+	pui8_search = &ps_compress->pui8_window[ i_pos ];
+	i_best_match_length = MDEFLATE_MATCH_LENGTH_OFFSET - 1;
+	i_num_matches = 0;
 
-	i_length_and_offset_idx = 0;
-	for( i_idx = 0; i_idx < s_compress.i_symbol_count; i_idx++ )
+	i_chain = ps_compress->rgui_hash_head[ mdeflate_hash( pui8_search ) ];
+	for( i_depth = ps_compress->s_params.i_max_chain_depth; i_chain > 0 && i_depth > 0; i_depth-- )
 	{
-		int32_t i_symbol, i_offset_symbol;
-		i_symbol = s_compress.rgui8_symbols[ i_idx ];
-#if MDEFLATE_DEBUG_PRINTF > 2
-		printf("esym %d\n", i_symbol );
-#endif
-		mdeflate_write_bits( &s_compress, s_compress.rgs_symbol_nodes[ i_symbol ].i_cw, s_compress.rgs_symbol_nodes[ i_symbol ].i_cw_length );
-		if( i_symbol > MDEFLATE_END_OF_BLOCK_NODE )
+		i_chain -= 1;
+		if( i_chain < i_min_pos )
 		{
-			mdeflate_write_bits( &s_compress, s_compress.rgi_length_and_offset[ i_length_and_offset_idx++ ], rgi_length_extra[ i_symbol - MDEFLATE_LENGTH_NODES_OFFSET ] );
-			i_offset_symbol = s_compress.rgui8_symbols[ ++i_idx ];
-			mdeflate_write_bits( &s_compress, s_compress.rgs_offset_nodes[ i_offset_symbol ].i_cw, s_compress.rgs_offset_nodes[ i_offset_symbol ].i_cw_length );
-			mdeflate_write_bits( &s_compress, s_compress.rgi_length_and_offset[ i_length_and_offset_idx++ ], rgi_offset_extra[ i_offset_symbol ] );
-#if MDEFLATE_DEBUG_PRINTF > 2
-			printf("eoff %d\n", i_offset_symbol );
-#endif
+			break;
 		}
-		else if( i_symbol <= MDEFLATE_MAX_LITERAL_NODE )
+		pui8_candidate = &ps_compress->pui8_window[ i_chain ];
+		/* the candidate has to match the byte past the best match and its predecessor to be longer */
+		if( mdeflate_match_candidate( pui8_candidate, pui8_search, i_best_match_length ) )
 		{
-			i_symbol = s_compress.rgui8_symbols[ ++i_idx ];
-#if MDEFLATE_DEBUG_PRINTF > 2
-		printf("esym2 %d\n", i_symbol );
-#endif
-			if( i_symbol > MDEFLATE_MAX_LITERAL_NODE )
+			i_match = ps_compress->pf_match_length( pui8_candidate, pui8_search, 2, i_max_match_length );
+			if( i_match > i_best_match_length )
 			{
-				fprintf( stderr, "compression error, second literal symbol is no literal symbol\n");
-				exit( 1 );
+				i_best_match_length = i_match;
+				if( i_num_matches == i_max_matches ) /* keep the longest */
+				{
+					i_num_matches--;
+				}
+				pui16_lengths[ i_num_matches ] = i_match;
+				pui_offsets[ i_num_matches ] = i_pos - i_chain;
+				i_num_matches++;
+				if( i_match >= ps_compress->s_params.i_nice_match_length || i_match >= i_max_match_length )
+				{
+					break;
+				}
 			}
-#if !WITH_LITERAL_ONLY_TREE
-			mdeflate_write_bits( &s_compress, s_compress.rgs_symbol_nodes[ i_symbol ].i_cw, s_compress.rgs_symbol_nodes[ i_symbol ].i_cw_length );
-#else
-			mdeflate_write_bits( &s_compress, s_compress.rgs_literal_nodes[ i_symbol ].i_cw, s_compress.rgs_literal_nodes[ i_symbol ].i_cw_length );
-#endif
 		}
+		i_chain = ps_compress->pui_hash_chain[ i_chain ];
 	}
-	if( s_compress.i_cw_bits > 0 )
-	{
-		s_compress.pui8_bitstream[ s_compress.i_bitstream_size++ ] = s_compress.ui_cw >> 24;
-	}
-	return s_compress.i_bitstream_size;
-}
-
-
-
-/* ------------------------ UNCOMPRESS ------------------------ */
-
-typedef struct {
-	int8_t i8_bits;
-	uint16_t ui16_cw;
-	uint8_t *pui8_bitstream;
-
-	uint8_t ui8_out_slot;
-	uint8_t *pui8_out;
-
-	uint8_t rgui8_symbol_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
-	uint8_t rgui8_symbol_length_lut[ MDEFLATE_MAX_SYMBOL_NODES ];
-#if WITH_LITERAL_ONLY_TREE
-	uint8_t rgui8_literal_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
-	uint8_t rgui8_literal_length_lut[ MDEFLATE_MAX_LITERAL_NODES ];
-#endif
-	uint8_t rgui8_offset_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
-	uint8_t rgui8_offset_length_lut[ MDEFLATE_MAX_OFFSET_NODES ];
-
-	uint16_t rgui16_offset_offset[ MDEFLATE_MAX_OFFSET_NODES ];
-	uint8_t rgui8_length_offset[ MDEFLATE_MAX_SYMBOL_NODES ];
-} minflate_uncompress_t;
-
 
-uint8_t minflate_read_bits( minflate_uncompress_t *ps_uncompress, uint8_t ui8_length )
-{
-	uint8_t ui8_cw;
-	ui8_cw = ps_uncompress->ui16_cw >> ( 16 - ui8_length );
-	ps_uncompress->ui16_cw <<= ui8_length;
-	ps_uncompress->i8_bits -= ui8_length;
-	if( ps_uncompress->i8_bits < 0 )
-	{
-		ps_uncompress->ui16_cw |= ( *( ps_uncompress->pui8_bitstream++ ) ) << ( -ps_uncompress->i8_bits );
-		ps_uncompress->i8_bits += 8;
-	}
-	return ui8_cw;
+	return i_num_matches;
 }
 
 
-void minflate_init_length_and_offset_table( minflate_uncompress_t *ps_uncompress )
+int32_t mdeflate_find_match( mdeflate_compress_t *ps_compress, int32_t i_pos, int32_t i_search_end, int32_t *pi_offset )
 {
-	int32_t i_symbol_idx, i_symbol_offset;
+	uint16_t ui16_length;
+	uint32_t ui_offset;
 
-	i_symbol_offset = 0;
-	for( i_symbol_idx = 0; i_symbol_idx < MDEFLATE_MAX_OFFSET_NODES; i_symbol_idx++ )
-	{
-		ps_uncompress->rgui16_offset_offset[ i_symbol_idx ] = i_symbol_offset;
-		i_symbol_offset += 1 << rgi_offset_extra[ i_symbol_idx ];
-	}
+	*pi_offset = 0;
 
-	i_symbol_offset = 0;
-	for( i_symbol_idx = 0; i_symbol_idx < MDEFLATE_MAX_LENGTH_NODES; i_symbol_idx++ )
+	if( !mdeflate_find_matches( ps_compress, i_pos, i_search_end, &ui16_length, &ui_offset, 1 ) )
 	{
-		ps_uncompress->rgui8_length_offset[ i_symbol_idx ] = i_symbol_offset;
-		i_symbol_offset += 1 << rgi_length_extra[ i_symbol_idx ];
+		return 0;
 	}
-}
-
 
-void minflate_assign_cw( minflate_uncompress_t *ps_uncompress, int8_t i8_num_nodes, uint8_t *pui8_length_lut, uint8_t *pui8_lut )
-{
-	int8_t i8_cw_length, i8_node;
-	uint8_t ui8_cw, ui8_idx;
-	
-	ui8_cw = 0;
-	for( i8_cw_length = 1; i8_cw_length <= MDEFLATE_MAX_CW_LENGTH; i8_cw_length++ )
+	if( ui16_length == MDEFLATE_MATCH_LENGTH_OFFSET ) /* sanity */
 	{
-		for( i8_node = 0; i8_node < i8_num_nodes; i8_node++ )
+		int32_t i_offset_symbol, i_offset_size;
+		i_offset_symbol = ps_compress->pui8_offset_lut[ ui_offset - 1 ];
+		i_offset_size = ps_compress->s_format.rgi_offset_extra[ i_offset_symbol ];
+		if( ( i_offset_size + 14 ) > ( ui16_length * 8 ) )
 		{
-			if( pui8_length_lut[ i8_node ] == i8_cw_length )
-			{
-				uint8_t ui8_dim = 1 << ( 8 - i8_cw_length );
-				for( ui8_idx = 0; ui8_idx < ui8_dim; ui8_idx++ )
-				{
-					pui8_lut[ ui8_cw++ ] = i8_node;
-				}
-			}
+			return 0;
 		}
 	}
+
+	*pi_offset = ui_offset;
+	return ui16_length;
 }
 
 
-void minflate_read_and_assign_bl_cw( minflate_uncompress_t *ps_uncompress, int8_t i8_num_nodes, uint8_t *pui8_length_lut, uint8_t *pui8_lut )
+void mdeflate_clear_nodes( mdeflate_compress_t *ps_compress )
 {
-	int8_t i8_node;
+	memset( ps_compress->rgs_symbol_nodes, 0, sizeof( ps_compress->rgs_symbol_nodes ) );
+	memset( ps_compress->rgs_literal_nodes, 0, sizeof( ps_compress->rgs_literal_nodes ) );
+	memset( ps_compress->rgs_offset_nodes, 0, sizeof( ps_compress->rgs_offset_nodes ) );
+	memset( ps_compress->rgs_byte_nodes, 0, sizeof( ps_compress->rgs_byte_nodes ) );
+	memset( ps_compress->rgs_bl_nodes, 0, sizeof( ps_compress->rgs_bl_nodes ) );
+}
 
-	for( i8_node = 0; i8_node < i8_num_nodes; i8_node++ )
-	{
-		pui8_length_lut[ i8_node ] = minflate_read_bits( ps_uncompress, 3 );
-#if MDEFLATE_DEBUG_PRINTF > 1
-		printf("node %d, l %d\n", i8_node, pui8_length_lut[ i8_node ] );
-#endif
-	}
 
-	minflate_assign_cw( ps_uncompress, i8_num_nodes, pui8_length_lut, pui8_lut );
+void mdeflate_reset_symbols( mdeflate_compress_t *ps_compress )
+{
+	mdeflate_clear_nodes( ps_compress );
+	ps_compress->i_symbol_count = 0;
+	ps_compress->i_length_and_offset_count = 0;
+	ps_compress->i_length_literal = 0;
+	ps_compress->i_length_bcopy = 0;
 }
 
-uint8_t minflate_read_symbol( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_node_lut, uint8_t *pui8_node_length_lut )
+
+void mdeflate_add_literal( mdeflate_compress_t *ps_compress, uint8_t ui8_literal )
 {
-	uint8_t ui8_sym, ui8_len;
+	int32_t i_symbol;
 
-	ui8_sym = pui8_node_lut[ ps_uncompress->ui16_cw >> 8 ];
-	ui8_len = pui8_node_length_lut[ ui8_sym ];
+	i_symbol = ui8_literal & 0xf;
+	ps_compress->rgs_symbol_nodes[ i_symbol ].i_count++;
+	ps_compress->pui8_symbols[ ps_compress->i_symbol_count++ ] = i_symbol;
 
-	ps_uncompress->ui16_cw <<= ui8_len;
-	ps_uncompress->i8_bits -= ui8_len;
-	if( ps_uncompress->i8_bits < 0 )
-	{
-		ps_uncompress->ui16_cw |= ( *( ps_uncompress->pui8_bitstream++ ) ) << ( -ps_uncompress->i8_bits );
-		ps_uncompress->i8_bits += 8;
-	}
+	i_symbol = ( ui8_literal >> 4 ) & 0xf;
+	ps_compress->rgs_literal_nodes[ i_symbol ].i_count++;
+	ps_compress->pui8_symbols[ ps_compress->i_symbol_count++ ] = i_symbol;
 
-	return ui8_sym;
+	ps_compress->i_length_literal += 1;
 }
 
-void minflate_read_lengths( minflate_uncompress_t *ps_uncompress, int8_t i8_num_nodes, uint8_t *pui8_bl_length_lut, uint8_t *pui8_bl_lut, uint8_t *pui8_length_lut )
-{
-	int8_t i8_idx;
 
-	for( i8_idx = 0; i8_idx < i8_num_nodes; i8_idx++ )
-	{
-		pui8_length_lut[ i8_idx ] = minflate_read_symbol( ps_uncompress, pui8_bl_lut, pui8_bl_length_lut );
-	}
-}
+void mdeflate_add_match( mdeflate_compress_t *ps_compress, int32_t i_length, int32_t i_offset )
+{
+	int32_t i_symbol, i_offset_symbol;
 
+#if MDEFLATE_DEBUG_PRINTF > 1
+	printf("match %d %d\n", i_length, i_offset );
+#endif
+	ps_compress->i_length_bcopy += i_length;
 
-int32_t minflate_dec_block( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data )
-{
-	minflate_uncompress_t s_uncompress;
-	uint8_t ui8_sym;
-	int32_t i_length_literal, i_length_bcopy;
+	i_length -= MDEFLATE_MATCH_LENGTH_OFFSET;
+	i_symbol = ps_compress->rgui8_length_lut[ i_length ];
+	i_length -= ps_compress->rgui_length_offset[ i_symbol ];
+	i_symbol += MDEFLATE_LENGTH_NODES_OFFSET;
 
-	memset( &s_uncompress, 0, sizeof( s_uncompress ) );
+	i_offset -= 1;
+	i_offset_symbol = ps_compress->pui8_offset_lut[ i_offset ];
+	i_offset -= ps_compress->rgui_offset_offset[ i_offset_symbol ];
 
-	minflate_init_length_and_offset_table( &s_uncompress );
+	ps_compress->rgs_symbol_nodes[ i_symbol ].i_count++;
+	ps_compress->pui8_symbols[ ps_compress->i_symbol_count++ ] = i_symbol;
 
-	s_uncompress.i8_bits = 8;
-	s_uncompress.ui16_cw = ( pui8_in_data[ 0 ] << 8 ) | pui8_in_data[ 1 ];
-	s_uncompress.pui8_bitstream = pui8_in_data + 2;
+	ps_compress->rgs_offset_nodes[ i_offset_symbol ].i_count++;
+	ps_compress->pui8_symbols[ ps_compress->i_symbol_count++ ] = i_offset_symbol;
+	ps_compress->pi_length_and_offset[ ps_compress->i_length_and_offset_count++ ] = i_length;
+	ps_compress->pi_length_and_offset[ ps_compress->i_length_and_offset_count++ ] = i_offset;
+}
 
-	s_uncompress.ui8_out_slot = 0;
-	s_uncompress.pui8_out = pui8_out_data;
 
-	minflate_read_and_assign_bl_cw( &s_uncompress, MDEFLATE_MAX_BL_NODES, &s_uncompress.rgui8_symbol_lut[ 0 ], &s_uncompress.rgui8_offset_lut[ 0 ] );
+void mdeflate_parse_store( mdeflate_compress_t *ps_compress, int32_t i_in_data_length )
+{
+	int32_t i_idx;
+	uint8_t *pui8_in_data;
 
-	minflate_read_lengths( &s_uncompress, MDEFLATE_MAX_SYMBOL_NODES, &s_uncompress.rgui8_symbol_lut[ 0 ], &s_uncompress.rgui8_offset_lut[ 0 ], &s_uncompress.rgui8_symbol_length_lut[ 0 ] );
-#if WITH_LITERAL_ONLY_TREE
-	minflate_read_lengths( &s_uncompress, MDEFLATE_MAX_LITERAL_NODES, &s_uncompress.rgui8_symbol_lut[ 0 ], &s_uncompress.rgui8_offset_lut[ 0 ], &s_uncompress.rgui8_literal_length_lut[ 0 ] );
-#endif
-	minflate_read_lengths( &s_uncompress, MDEFLATE_MAX_OFFSET_NODES, &s_uncompress.rgui8_symbol_lut[ 0 ], &s_uncompress.rgui8_offset_lut[ 0 ], &s_uncompress.rgui8_offset_length_lut[ 0 ] );
+	pui8_in_data = &ps_compress->pui8_window[ ps_compress->i_codebook_back ];
+	for( i_idx = 0; i_idx < i_in_data_length; i_idx++ )
+	{
+		mdeflate_add_literal( ps_compress, pui8_in_data[ i_idx ] );
+	}
+}
 
-	minflate_assign_cw( &s_uncompress, MDEFLATE_MAX_SYMBOL_NODES, &s_uncompress.rgui8_symbol_length_lut[ 0 ], &s_uncompress.rgui8_symbol_lut[ 0 ] );
-#if WITH_LITERAL_ONLY_TREE
-	minflate_assign_cw( &s_uncompress, MDEFLATE_MAX_LITERAL_NODES, &s_uncompress.rgui8_literal_length_lut[ 0 ], &s_uncompress.rgui8_literal_lut[ 0 ] );
-#endif
-	minflate_assign_cw( &s_uncompress, MDEFLATE_MAX_OFFSET_NODES, &s_uncompress.rgui8_offset_length_lut[ 0 ], &s_uncompress.rgui8_offset_lut[ 0 ] );
 
+void mdeflate_parse_lazy( mdeflate_compress_t *ps_compress, int32_t i_in_data_length, int32_t i_max_lookahead )
+{
+	int32_t i_idx, i_lookahead, i_length, i_offset, i_next_length, i_next_offset, i_window_start, i_window_end;
+	uint8_t *pui8_in_data;
 
-	i_length_literal = i_length_bcopy = 0;
+	i_window_start = ps_compress->i_codebook_back;
+	i_window_end = i_window_start + i_in_data_length;
+	pui8_in_data = &ps_compress->pui8_window[ i_window_start ];
 
-	do {
-		ui8_sym = minflate_read_symbol( &s_uncompress, s_uncompress.rgui8_symbol_lut, s_uncompress.rgui8_symbol_length_lut );
-		if( ui8_sym <= MDEFLATE_MAX_LITERAL_NODE )
+	for( i_idx = 0; i_idx < i_in_data_length; )
+	{
+		i_length = mdeflate_find_match( ps_compress, i_window_start + i_idx, i_window_end, &i_offset );
+		if( i_length == 0 )
 		{
-#if !WITH_LITERAL_ONLY_TREE
-			ui8_sym |= ( minflate_read_symbol( &s_uncompress, s_uncompress.rgui8_symbol_lut, s_uncompress.rgui8_symbol_length_lut ) ) << 4;
-#else
-			ui8_sym |= ( minflate_read_symbol( &s_uncompress, s_uncompress.rgui8_literal_lut, s_uncompress.rgui8_literal_length_lut ) ) << 4;
-#endif
-			*( s_uncompress.pui8_out++ ) = ui8_sym;
-			ui8_sym = 0;
-			i_length_literal++;
+			mdeflate_add_literal( ps_compress, pui8_in_data[ i_idx ] );
+			i_idx += 1;
+			continue;
 		}
-		else if( ui8_sym >= MDEFLATE_LENGTH_NODES_OFFSET )
-		{
-			uint8_t ui8_length_sym, ui8_offset_sym, ui8_length, *pui8_bcopy, ui8_length_extra;
-			int16_t i16_offset, i16_offset_extra;
-
-			ui8_length_sym = ui8_sym - MDEFLATE_LENGTH_NODES_OFFSET;
-			ui8_length = s_uncompress.rgui8_length_offset[ ui8_length_sym ];
-			ui8_length_extra = minflate_read_bits( &s_uncompress, rgi_length_extra[ ui8_length_sym ] );
-			ui8_length += ui8_length_extra;
-			ui8_length += MDEFLATE_MATCH_LENGTH_OFFSET;
-			ui8_offset_sym = minflate_read_symbol( &s_uncompress, s_uncompress.rgui8_offset_lut, s_uncompress.rgui8_offset_length_lut );
-			i16_offset = s_uncompress.rgui16_offset_offset[ ui8_offset_sym ];
-			i16_offset_extra = minflate_read_bits( &s_uncompress, rgi_offset_extra[ ui8_offset_sym ] );
-			i16_offset += i16_offset_extra;
-			i16_offset += 1;
 
-#if MDEFLATE_DEBUG_PRINTF > 1
-			printf("bcopy %d %d (%d %d )\n", ui8_length, i16_offset, ui8_length_extra, i16_offset_extra );
-#endif
-			i_length_bcopy += ui8_length;
-
-			pui8_bcopy = s_uncompress.pui8_out - i16_offset;
-			while( ui8_length > 0 )
+		/* emit a literal instead while the next position has the longer match */
+		for( i_lookahead = 0; i_lookahead < i_max_lookahead; i_lookahead++ )
+		{
+			if( i_length >= ps_compress->s_params.i_lazy_match_length || ( i_idx + 1 ) >= i_in_data_length )
+			{
+				break;
+			}
+			i_next_length = mdeflate_find_match( ps_compress, i_window_start + i_idx + 1, i_window_end, &i_next_offset );
+			if( i_next_length <= i_length )
 			{
-				*( s_uncompress.pui8_out++ ) = *( pui8_bcopy++ );
-				ui8_length--;
+				break;
 			}
+			mdeflate_add_literal( ps_compress, pui8_in_data[ i_idx ] );
+			i_idx += 1;
+			i_length = i_next_length;
+			i_offset = i_next_offset;
 		}
-	} while( ui8_sym != MDEFLATE_END_OF_BLOCK_NODE );
-
-#if MDEFLATE_DEBUG_PRINTF > 0
-	printf("ustats: %d %d %d\n", i_length_literal, i_length_bcopy, i_length_literal + i_length_bcopy );
-#endif
 
-	return ( int32_t ) ( s_uncompress.pui8_out - pui8_out_data );
+		mdeflate_add_match( ps_compress, i_length, i_offset );
+		i_idx += i_length;
+	}
 }
 
 
-/* ------------------------ MAIN ------------------------ */
+int32_t mdeflate_symbol_price( encnode_t *ps_node )
+{
+	return ps_node->i_cw_length > 0 ? ps_node->i_cw_length : MDEFLATE_UNUSED_SYMBOL_PRICE;
+}
 
 
-int main( int i_argc, char *argv[ ] )
+void mdeflate_update_prices( mdeflate_compress_t *ps_compress )
 {
-	FILE *f_in, *f_out;
-	uint8_t rgui8_data[ MDEFLATE_BLOCK_SIZE ];
-	uint8_t rgui8_edata[ MDEFLATE_BLOCK_SIZE + MDEFLATE_BLOCK_SIZE / 5 ];
-	uint8_t rgui8_ddata[ MDEFLATE_BLOCK_SIZE ];
-	int32_t i_data_size, i_edata_size, i_ddata_size, i_ret, i_cb_size;
+	int32_t i_idx, i_symbol;
+	mdeflate_optimal_t *ps_optimal = ps_compress->ps_optimal;
 
-	if( i_argc < 3 )
+	ps_compress->rgs_symbol_nodes[ MDEFLATE_END_OF_BLOCK_NODE ].i_count++;
+	mdeflate_construct_tree( ps_compress, &ps_compress->rgs_symbol_nodes[ 0 ], MDEFLATE_MAX_SYMBOL_NODES, MDEFLATE_MAX_CW_LENGTH );
+	mdeflate_construct_tree( ps_compress, &ps_compress->rgs_literal_nodes[ 0 ], MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_CW_LENGTH );
+	mdeflate_construct_tree( ps_compress, &ps_compress->rgs_offset_nodes[ 0 ], MDEFLATE_MAX_OFFSET_NODES, MDEFLATE_MAX_CW_LENGTH );
+
+	for( i_idx = 0; i_idx < 256; i_idx++ )
 	{
-		printf("usage: <option> infile outfile\nwhere option is either 'c' for compress or 'd' for decompress\n");
-		exit( 1 );
+		ps_optimal->rgi_literal_price[ i_idx ] = mdeflate_symbol_price( &ps_compress->rgs_symbol_nodes[ i_idx & 0xf ] );
+		ps_optimal->rgi_literal_price[ i_idx ] += mdeflate_symbol_price( &ps_compress->rgs_literal_nodes[ i_idx >> 4 ] );
 	}
-	
-	if( argv[ 1 ][ 0 ] == 'c' && argv[ 1 ][ 1 ] == 0 )
+	for( i_idx = 0; i_idx <= ps_compress->i_max_match_length - MDEFLATE_MATCH_LENGTH_OFFSET; i_idx++ )
 	{
-		f_in = fopen( argv[ 2 ], "rb" );
-		if( f_in == NULL )
-		{
-			printf("unable to open \"%s\" for reading\n", argv[ 2 ] );
-			exit( 1 );
-		}
-		f_out = fopen( argv[ 3 ], "wb" );
-		if( f_out == NULL )
-		{
-			printf("unable to open \"%s\" for writing\n", argv[ 3 ] );
-			exit( 1 );
-		}
+		i_symbol = ps_compress->rgui8_length_lut[ i_idx ];
+		ps_optimal->rgi_length_price[ i_idx ] = mdeflate_symbol_price( &ps_compress->rgs_symbol_nodes[ i_symbol + MDEFLATE_LENGTH_NODES_OFFSET ] ) + rgi_length_extra[ i_symbol ];
+	}
+	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+	{
+		ps_optimal->rgi_offset_price[ i_idx ] = mdeflate_symbol_price( &ps_compress->rgs_offset_nodes[ i_idx ] ) + ps_compress->s_format.rgi_offset_extra[ i_idx ];
+	}
+}
 
-		i_cb_size = 0;
-		while( 1 )
+
+void mdeflate_parse_optimal( mdeflate_compress_t *ps_compress, int32_t i_in_data_length )
+{
+	int32_t i_idx, i_match, i_num_matches, i_length, i_offset, i_skip_end, i_skip_offset, i_pass, i_window_start, i_window_end;
+	uint32_t ui_price, ui_match_price;
+	uint16_t *pui16_lengths;
+	uint32_t *pui_offsets;
+	uint8_t *pui8_in_data;
+	mdeflate_optimal_t *ps_optimal = ps_compress->ps_optimal;
+
+	i_window_start = ps_compress->i_codebook_back;
+	i_window_end = i_window_start + i_in_data_length;
+	pui8_in_data = &ps_compress->pui8_window[ i_window_start ];
+
+	/* collect match candidates, positions covered by a nice match only get its tail */
+	i_skip_end = i_skip_offset = 0;
+	for( i_idx = 0; i_idx < i_in_data_length; i_idx++ )
+	{
+		pui16_lengths = &ps_optimal->pui16_match_length[ i_idx * MDEFLATE_OPTIMAL_MAX_MATCHES ];
+		pui_offsets = &ps_optimal->pui_match_offset[ i_idx * MDEFLATE_OPTIMAL_MAX_MATCHES ];
+		if( i_idx < i_skip_end )
 		{
-			i_ret = fread( &rgui8_data[ MDEFLATE_BLOCK_SIZE / 2 ], sizeof( uint8_t ), MDEFLATE_BLOCK_SIZE / 2, f_in ); /* / 2 because of nibbles */
-#if MDEFLATE_DEBUG_PRINTF > 0
-			printf("block, %d bytes\n", i_ret );
-#endif
-			if( i_ret > 0 )
+			i_num_matches = 0;
+			if( i_skip_end - i_idx >= MDEFLATE_MATCH_LENGTH_OFFSET )
 			{
-				i_data_size = i_ret;
-				i_edata_size = mdeflate_enc_block( &rgui8_data[ MDEFLATE_BLOCK_SIZE / 2 ], i_data_size, &rgui8_edata[ 2 ], i_cb_size );
-				rgui8_edata[ 0 ] = ( i_edata_size >> 8 ) & 0xff;
-				rgui8_edata[ 1 ] = ( i_edata_size      ) & 0xff;
-				i_ret = fwrite( rgui8_edata, i_edata_size + 2, sizeof( uint8_t ), f_out );
-				printf( "%d %d ( %.2f )\n", i_data_size, i_edata_size, ( ( float ) i_edata_size ) / ( ( float )i_data_size ) );
-				memcpy( &rgui8_data[ ( MDEFLATE_BLOCK_SIZE / 2 ) - i_data_size ], &rgui8_data[ MDEFLATE_BLOCK_SIZE / 2 ], sizeof( uint8_t ) * i_data_size );
-				i_cb_size = i_data_size;
+				pui16_lengths[ 0 ] = i_skip_end - i_idx;
+				pui_offsets[ 0 ] = i_skip_offset;
+				i_num_matches = 1;
 			}
-			else
+		}
+		else
+		{
+			i_num_matches = mdeflate_find_matches( ps_compress, i_window_start + i_idx, i_window_end, pui16_lengths, pui_offsets, MDEFLATE_OPTIMAL_MAX_MATCHES );
+			if( i_num_matches > 0 && pui16_lengths[ i_num_matches - 1 ] >= ps_compress->s_params.i_nice_match_length )
 			{
-				rgui8_edata[ 0 ] = 0;
-				rgui8_edata[ 1 ] = 0;
-				i_edata_size = 2;
-				i_ret = fwrite( rgui8_edata, i_edata_size, sizeof( uint8_t ), f_out );
-				break;
+				i_skip_end = i_idx + pui16_lengths[ i_num_matches - 1 ];
+				i_skip_offset = pui_offsets[ i_num_matches - 1 ];
 			}
 		}
+		ps_optimal->pui16_match_count[ i_idx ] = i_num_matches;
 	}
-	else if( argv[ 1 ][ 0 ] == 'd' && argv[ 1 ][ 1 ] == 0 )
+
+	/* greedy parse for the initial statistics */
+	for( i_idx = 0; i_idx < i_in_data_length; )
+	{
+		i_num_matches = ps_optimal->pui16_match_count[ i_idx ];
+		if( i_num_matches > 0 )
+		{
+			i_match = i_idx * MDEFLATE_OPTIMAL_MAX_MATCHES + i_num_matches - 1;
+			i_length = ps_optimal->pui16_match_length[ i_match ];
+			mdeflate_add_match( ps_compress, i_length, ps_optimal->pui_match_offset[ i_match ] );
+			i_idx += i_length;
+		}
+		else
+		{
+			mdeflate_add_literal( ps_compress, pui8_in_data[ i_idx ] );
+			i_idx += 1;
+		}
+	}
+
+	for( i_pass = 0; i_pass < MDEFLATE_OPTIMAL_PASSES; i_pass++ )
 	{
-		uint16_t ui16_blocksize;
+		mdeflate_update_prices( ps_compress );
+		mdeflate_reset_symbols( ps_compress );
 
-		f_in = fopen( argv[ 2 ], "rb" );
-		if( f_in == NULL )
+		ps_optimal->pui_price[ 0 ] = 0;
+		for( i_idx = 1; i_idx <= i_in_data_length; i_idx++ )
 		{
-			printf("unable to open \"%s\" for reading\n", argv[ 2 ] );
-			exit( 1 );
+			ps_optimal->pui_price[ i_idx ] = 0xffffffff;
 		}
-		f_out = fopen( argv[ 3 ], "wb" );
-		if( f_out == NULL )
+
+		for( i_idx = 0; i_idx < i_in_data_length; i_idx++ )
 		{
-			printf("unable to open \"%s\" for writing\n", argv[ 3 ] );
-			exit( 1 );
+			ui_price = ps_optimal->pui_price[ i_idx ] + ps_optimal->rgi_literal_price[ pui8_in_data[ i_idx ] ];
+			if( ui_price < ps_optimal->pui_price[ i_idx + 1 ] )
+			{
+				ps_optimal->pui_price[ i_idx + 1 ] = ui_price;
+				ps_optimal->pui16_step_length[ i_idx + 1 ] = 1;
+				ps_optimal->pui_step_offset[ i_idx + 1 ] = 0;
+			}
+
+			i_length = MDEFLATE_MATCH_LENGTH_OFFSET;
+			i_num_matches = ps_optimal->pui16_match_count[ i_idx ];
+			for( i_match = i_idx * MDEFLATE_OPTIMAL_MAX_MATCHES; i_num_matches > 0; i_match++, i_num_matches-- )
+			{
+				i_offset = ps_optimal->pui_match_offset[ i_match ];
+				ui_match_price = ps_optimal->pui_price[ i_idx ] + ps_optimal->rgi_offset_price[ ps_compress->pui8_offset_lut[ i_offset - 1 ] ];
+				for( ; i_length <= ps_optimal->pui16_match_length[ i_match ]; i_length++ )
+				{
+					ui_price = ui_match_price + ps_optimal->rgi_length_price[ i_length - MDEFLATE_MATCH_LENGTH_OFFSET ];
+					if( ui_price < ps_optimal->pui_price[ i_idx + i_length ] )
+					{
+						ps_optimal->pui_price[ i_idx + i_length ] = ui_price;
+						ps_optimal->pui16_step_length[ i_idx + i_length ] = i_length;
+						ps_optimal->pui_step_offset[ i_idx + i_length ] = i_offset;
+					}
+				}
+			}
 		}
-		
-		while( 1 )
+
+		/* walk the cheapest path back and replay it forward */
+		for( i_idx = i_in_data_length; i_idx > 0; i_idx -= i_length )
 		{
-			ui16_blocksize = fgetc( f_in ) << 8;
-			ui16_blocksize |= fgetc( f_in );
-			if( ui16_blocksize > 0 )
+			i_length = ps_optimal->pui16_step_length[ i_idx ];
+			ps_optimal->pui16_parse_length[ i_idx - i_length ] = i_length;
+			ps_optimal->pui_parse_offset[ i_idx - i_length ] = ps_optimal->pui_step_offset[ i_idx ];
+		}
+		for( i_idx = 0; i_idx < i_in_data_length; i_idx += i_length )
+		{
+			i_length = ps_optimal->pui16_parse_length[ i_idx ];
+			if( i_length > 1 )
 			{
-				i_ret = fread( &rgui8_edata[ 0 ], ui16_blocksize, 1, f_in );
-				i_ddata_size = minflate_dec_block( rgui8_edata, ui16_blocksize * sizeof( uint8_t ), &rgui8_ddata[ MDEFLATE_BLOCK_SIZE / 2 ] );
-				printf( "%d -> %d ( %.2f )\n", ui16_blocksize + 2, i_ddata_size, ( ( float ) ui16_blocksize ) / ( ( float ) i_ddata_size ) );
-				fwrite( &rgui8_ddata[ MDEFLATE_BLOCK_SIZE / 2 ], i_ddata_size  * sizeof( uint8_t ), 1, f_out );
-				memcpy( &rgui8_ddata[ ( MDEFLATE_BLOCK_SIZE / 2 ) - ( int32_t )i_ddata_size ], &rgui8_ddata[ MDEFLATE_BLOCK_SIZE / 2 ], i_ddata_size * sizeof( uint8_t ) );
+				mdeflate_add_match( ps_compress, i_length, ps_optimal->pui_parse_offset[ i_idx ] );
 			}
 			else
 			{
-				break;
+				mdeflate_add_literal( ps_compress, pui8_in_data[ i_idx ] );
 			}
 		}
 	}
+}
+
+
+/* counts the parsed symbols from i_first_symbol to i_end_symbol into the nodes, with i_byte_literals also into the byte tree */
+void mdeflate_count_symbols( mdeflate_compress_t *ps_compress, int32_t i_first_symbol, int32_t i_end_symbol )
+{
+	int32_t i_idx, i_symbol;
+
+	mdeflate_clear_nodes( ps_compress );
+	for( i_idx = i_first_symbol; i_idx < i_end_symbol; i_idx += 2 )
+	{
+		i_symbol = ps_compress->pui8_symbols[ i_idx ];
+		ps_compress->rgs_symbol_nodes[ i_symbol ].i_count++;
+		if( i_symbol > MDEFLATE_END_OF_BLOCK_NODE )
+		{
+			ps_compress->rgs_offset_nodes[ ps_compress->pui8_symbols[ i_idx + 1 ] ].i_count++;
+		}
+		else
+		{
+			ps_compress->rgs_literal_nodes[ ps_compress->pui8_symbols[ i_idx + 1 ] ].i_count++;
+		}
+	}
+	ps_compress->rgs_symbol_nodes[ MDEFLATE_END_OF_BLOCK_NODE ].i_count++;
+
+	if( ps_compress->s_params.i_byte_literals )
+	{
+		for( i_idx = i_first_symbol; i_idx < i_end_symbol; i_idx += 2 )
+		{
+			i_symbol = ps_compress->pui8_symbols[ i_idx ];
+			if( i_symbol > MDEFLATE_END_OF_BLOCK_NODE )
+			{
+				ps_compress->rgs_byte_nodes[ i_symbol + MDEFLATE_BYTE_NODES_OFFSET ].i_count++;
+			}
+			else
+			{
+				ps_compress->rgs_byte_nodes[ i_symbol | ( ps_compress->pui8_symbols[ i_idx + 1 ] << 4 ) ].i_count++;
+			}
+		}
+		ps_compress->rgs_byte_nodes[ MDEFLATE_BYTE_END_OF_BLOCK_NODE ].i_count++;
+	}
+}
+
+
+/* bits of the counted symbols coded with the code lengths of ps_coded, -1 if a counted symbol has no code */
+int64_t mdeflate_coded_bits( encnode_t *ps_counted, encnode_t *ps_coded, int32_t i_num_nodes )
+{
+	int32_t i_idx;
+	int64_t i64_bits;
+
+	i64_bits = 0;
+	for( i_idx = 0; i_idx < i_num_nodes; i_idx++ )
+	{
+		if( ps_counted[ i_idx ].i_count > 0 )
+		{
+			if( ps_coded[ i_idx ].i_cw_length == 0 )
+			{
+				return -1;
+			}
+			i64_bits += ( int64_t )ps_counted[ i_idx ].i_count * ps_coded[ i_idx ].i_cw_length;
+		}
+	}
+	return i64_bits;
+}
+
+
+/* bits of the counted symbols with the tables of the previous block, -1 if they can not code them */
+int64_t mdeflate_reuse_bits( mdeflate_compress_t *ps_compress )
+{
+	int64_t i64_bits, i64_tree_bits;
+
+	if( !ps_compress->s_params.i_reuse_tables || !ps_compress->i_have_tables )
+	{
+		return -1;
+	}
+	if( ps_compress->i_prev_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		i64_bits = mdeflate_coded_bits( ps_compress->rgs_byte_nodes, ps_compress->rgs_prev_byte_nodes, MDEFLATE_MAX_BYTE_NODES );
+	}
+	else
+	{
+		i64_bits = mdeflate_coded_bits( ps_compress->rgs_symbol_nodes, ps_compress->rgs_prev_symbol_nodes, MDEFLATE_MAX_SYMBOL_NODES );
+		i64_tree_bits = mdeflate_coded_bits( ps_compress->rgs_literal_nodes, ps_compress->rgs_prev_literal_nodes, MDEFLATE_MAX_LITERAL_NODES );
+		i64_bits = i64_bits < 0 || i64_tree_bits < 0 ? -1 : i64_bits + i64_tree_bits;
+	}
+	i64_tree_bits = mdeflate_coded_bits( ps_compress->rgs_offset_nodes, ps_compress->rgs_prev_offset_nodes, MDEFLATE_MAX_OFFSET_NODES );
+	return i64_bits < 0 || i64_tree_bits < 0 ? -1 : i64_bits + i64_tree_bits + MDEFLATE_BLOCK_TYPE_BITS;
+}
+
+
+/* remembers the tables of the block just written as the ones the decoder knows */
+void mdeflate_keep_tables( mdeflate_compress_t *ps_compress )
+{
+	if( ps_compress->i_reused_tables )
+	{
+		return;
+	}
+	memcpy( ps_compress->rgs_prev_symbol_nodes, ps_compress->rgs_symbol_nodes, sizeof( ps_compress->rgs_symbol_nodes ) );
+	memcpy( ps_compress->rgs_prev_literal_nodes, ps_compress->rgs_literal_nodes, sizeof( ps_compress->rgs_literal_nodes ) );
+	memcpy( ps_compress->rgs_prev_offset_nodes, ps_compress->rgs_offset_nodes, sizeof( ps_compress->rgs_offset_nodes ) );
+	if( ps_compress->i_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		memcpy( ps_compress->rgs_prev_byte_nodes, ps_compress->rgs_byte_nodes, sizeof( ps_compress->rgs_byte_nodes ) );
+	}
+	ps_compress->i_prev_tree_layout = ps_compress->i_tree_layout;
+	ps_compress->i_have_tables = 1;
+}
+
+
+/* builds the huffman and bit length tables of i_tree_layout from the counted symbols and returns the bits of the block
+   coded with them. with MDEFLATE_TREE_SHARED the high literal nibbles are counted into the symbol tree, the literal
+   nodes then get the codes of the first symbol nodes so literals and kept tables do not need to care. with
+   MDEFLATE_TREE_BYTE the end of block and length symbol nodes get the codes of their byte nodes in the same way */
+int64_t mdeflate_build_tables( mdeflate_compress_t *ps_compress, int32_t i_tree_layout )
+{
+	int32_t i_idx, i_non_zero, i_num_bl_nodes;
+	int64_t i64_bits;
+
+	if( i_tree_layout == MDEFLATE_TREE_SHARED )
+	{
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_LITERAL_NODES; i_idx++ )
+		{
+			ps_compress->rgs_symbol_nodes[ i_idx ].i_count += ps_compress->rgs_literal_nodes[ i_idx ].i_count;
+		}
+	}
+
+	if( i_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		if( mdeflate_construct_tree( ps_compress, &ps_compress->rgs_byte_nodes[ 0 ], MDEFLATE_MAX_BYTE_NODES, MDEFLATE_MAX_BYTE_CW_LENGTH ) < 0 ||
+			mdeflate_assign_cw( ps_compress, &ps_compress->rgs_byte_nodes[ 0 ], MDEFLATE_MAX_BYTE_NODES ) < 0 )
+		{
+			return -1;
+		}
+	}
+	else if( mdeflate_construct_tree( ps_compress, &ps_compress->rgs_symbol_nodes[ 0 ], MDEFLATE_MAX_SYMBOL_NODES, MDEFLATE_MAX_CW_LENGTH ) < 0 ||
+		mdeflate_assign_cw( ps_compress, &ps_compress->rgs_symbol_nodes[ 0 ], MDEFLATE_MAX_SYMBOL_NODES ) < 0 )
+	{
+		return -1;
+	}
+	if( i_tree_layout == MDEFLATE_TREE_SEPARATE )
+	{
+		i_non_zero = mdeflate_construct_tree( ps_compress, &ps_compress->rgs_literal_nodes[ 0 ], MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_CW_LENGTH );
+		if( i_non_zero < 0 || ( i_non_zero > 0 && mdeflate_assign_cw( ps_compress, &ps_compress->rgs_literal_nodes[ 0 ], MDEFLATE_MAX_LITERAL_NODES ) < 0 ) )
+		{
+			return -1;
+		}
+	}
+	i_non_zero = mdeflate_construct_tree( ps_compress, &ps_compress->rgs_offset_nodes[ 0 ], MDEFLATE_MAX_OFFSET_NODES, MDEFLATE_MAX_CW_LENGTH );
+	if( i_non_zero < 0 || ( i_non_zero > 0 && mdeflate_assign_cw( ps_compress, &ps_compress->rgs_offset_nodes[ 0 ], MDEFLATE_MAX_OFFSET_NODES ) < 0 ) )
+	{
+		return -1;
+	}
+
+
+	if( i_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_BYTE_NODES; i_idx++ )
+		{
+			ps_compress->rgs_bl_nodes[ ps_compress->rgs_byte_nodes[ i_idx ].i_cw_length ].i_count++;
+		}
+	}
+	else
+	{
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
+		{
+			ps_compress->rgs_bl_nodes[ ps_compress->rgs_symbol_nodes[ i_idx ].i_cw_length ].i_count++;
+		}
+	}
+	if( i_tree_layout == MDEFLATE_TREE_SEPARATE )
+	{
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_LITERAL_NODES; i_idx++ )
+		{
+			ps_compress->rgs_bl_nodes[ ps_compress->rgs_literal_nodes[ i_idx ].i_cw_length ].i_count++;
+		}
+	}
+	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+	{
+		ps_compress->rgs_bl_nodes[ ps_compress->rgs_offset_nodes[ i_idx ].i_cw_length ].i_count++;
+	}
+
+	i_num_bl_nodes = i_tree_layout == MDEFLATE_TREE_BYTE ? MDEFLATE_MAX_BYTE_BL_NODES : MDEFLATE_MAX_BL_NODES;
+	if( mdeflate_construct_tree( ps_compress, &ps_compress->rgs_bl_nodes[ 0 ], i_num_bl_nodes, MDEFLATE_MAX_BL_CW_LENGTH ) < 0 ||
+		mdeflate_assign_cw( ps_compress, &ps_compress->rgs_bl_nodes[ 0 ], i_num_bl_nodes ) < 0 )
+	{
+		return -1;
+	}
+
+	/* the tables cost their bit length header, the counts include the dummy node of a single symbol tree */
+	i64_bits = i_num_bl_nodes * 3;
+	if( i_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		i64_bits += MDEFLATE_BLOCK_TYPE_BITS + mdeflate_coded_bits( ps_compress->rgs_byte_nodes, ps_compress->rgs_byte_nodes, MDEFLATE_MAX_BYTE_NODES );
+		for( i_idx = MDEFLATE_END_OF_BLOCK_NODE; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
+		{
+			ps_compress->rgs_symbol_nodes[ i_idx ] = ps_compress->rgs_byte_nodes[ i_idx + MDEFLATE_BYTE_NODES_OFFSET ];
+		}
+	}
+	else
+	{
+		i64_bits += mdeflate_coded_bits( ps_compress->rgs_symbol_nodes, ps_compress->rgs_symbol_nodes, MDEFLATE_MAX_SYMBOL_NODES );
+	}
+	if( i_tree_layout == MDEFLATE_TREE_SHARED )
+	{
+		i64_bits += MDEFLATE_BLOCK_TYPE_BITS;
+		memcpy( ps_compress->rgs_literal_nodes, ps_compress->rgs_symbol_nodes, sizeof( ps_compress->rgs_literal_nodes ) );
+	}
+	else if( i_tree_layout == MDEFLATE_TREE_SEPARATE )
+	{
+		i64_bits += mdeflate_coded_bits( ps_compress->rgs_literal_nodes, ps_compress->rgs_literal_nodes, MDEFLATE_MAX_LITERAL_NODES );
+	}
+	i64_bits += mdeflate_coded_bits( ps_compress->rgs_offset_nodes, ps_compress->rgs_offset_nodes, MDEFLATE_MAX_OFFSET_NODES );
+	for( i_idx = 0; i_idx < i_num_bl_nodes; i_idx++ )
+	{
+		i64_bits += ( int64_t )ps_compress->rgs_bl_nodes[ i_idx ].i_count * ps_compress->rgs_bl_nodes[ i_idx ].i_cw_length;
+	}
+	return i64_bits;
+}
+
+
+void mdeflate_save_tables( mdeflate_compress_t *ps_compress, mdeflate_tables_t *ps_tables )
+{
+	memcpy( ps_tables->rgs_symbol_nodes, ps_compress->rgs_symbol_nodes, sizeof( ps_tables->rgs_symbol_nodes ) );
+	memcpy( ps_tables->rgs_literal_nodes, ps_compress->rgs_literal_nodes, sizeof( ps_tables->rgs_literal_nodes ) );
+	memcpy( ps_tables->rgs_offset_nodes, ps_compress->rgs_offset_nodes, sizeof( ps_tables->rgs_offset_nodes ) );
+	memcpy( ps_tables->rgs_byte_nodes, ps_compress->rgs_byte_nodes, sizeof( ps_tables->rgs_byte_nodes ) );
+	memcpy( ps_tables->rgs_bl_nodes, ps_compress->rgs_bl_nodes, sizeof( ps_tables->rgs_bl_nodes ) );
+}
+
+
+void mdeflate_load_tables( mdeflate_compress_t *ps_compress, mdeflate_tables_t *ps_tables )
+{
+	memcpy( ps_compress->rgs_symbol_nodes, ps_tables->rgs_symbol_nodes, sizeof( ps_tables->rgs_symbol_nodes ) );
+	memcpy( ps_compress->rgs_literal_nodes, ps_tables->rgs_literal_nodes, sizeof( ps_tables->rgs_literal_nodes ) );
+	memcpy( ps_compress->rgs_offset_nodes, ps_tables->rgs_offset_nodes, sizeof( ps_tables->rgs_offset_nodes ) );
+	memcpy( ps_compress->rgs_byte_nodes, ps_tables->rgs_byte_nodes, sizeof( ps_tables->rgs_byte_nodes ) );
+	memcpy( ps_compress->rgs_bl_nodes, ps_tables->rgs_bl_nodes, sizeof( ps_tables->rgs_bl_nodes ) );
+}
+
+
+/* writes the symbols of mdeflate_write_block and the end of block */
+int32_t mdeflate_write_symbols( mdeflate_compress_t *ps_compress, int32_t i_first_symbol, int32_t i_end_symbol, int32_t i_first_extra, int32_t i_max_size )
+{
+	int32_t i_idx, i_length_and_offset_idx;
+
+	/* a literal pair, a byte literal or a match with its extra bits goes out as one codeword of at most 2 * 8, 12 or
+	   8 + 7 + 8 + 8 bits, matches with more than 8 offset extra bits or a byte tree length code may need a second write */
+	i_length_and_offset_idx = i_first_extra;
+	for( i_idx = i_first_symbol; i_idx < i_end_symbol; i_idx++ )
+	{
+		int32_t i_symbol, i_offset_symbol, i_length_extra, i_offset_extra, i_cw_length;
+		uint32_t ui_cw;
+		if( ps_compress->i_bitstream_size > i_max_size )
+		{
+			return ps_compress->i_bitstream_size;
+		}
+		i_symbol = ps_compress->pui8_symbols[ i_idx ];
+#if MDEFLATE_DEBUG_PRINTF > 2
+		printf("esym %d\n", i_symbol );
+#endif
+		ui_cw = ps_compress->rgs_symbol_nodes[ i_symbol ].i_cw;
+		i_cw_length = ps_compress->rgs_symbol_nodes[ i_symbol ].i_cw_length;
+		if( i_symbol > MDEFLATE_END_OF_BLOCK_NODE )
+		{
+			i_length_extra = rgi_length_extra[ i_symbol - MDEFLATE_LENGTH_NODES_OFFSET ];
+			ui_cw = ( ui_cw << i_length_extra ) | ps_compress->pi_length_and_offset[ i_length_and_offset_idx++ ];
+			i_offset_symbol = ps_compress->pui8_symbols[ ++i_idx ];
+			i_offset_extra = ps_compress->s_format.rgi_offset_extra[ i_offset_symbol ];
+			i_cw_length += i_length_extra;
+			if( i_cw_length + ps_compress->rgs_offset_nodes[ i_offset_symbol ].i_cw_length + i_offset_extra > 32 )
+			{
+				mdeflate_write_bits( ps_compress, ui_cw, i_cw_length );
+				ui_cw = 0;
+				i_cw_length = 0;
+			}
+			ui_cw = ( ui_cw << ps_compress->rgs_offset_nodes[ i_offset_symbol ].i_cw_length ) | ps_compress->rgs_offset_nodes[ i_offset_symbol ].i_cw;
+			ui_cw = ( ui_cw << i_offset_extra ) | ps_compress->pi_length_and_offset[ i_length_and_offset_idx++ ];
+			i_cw_length += ps_compress->rgs_offset_nodes[ i_offset_symbol ].i_cw_length + i_offset_extra;
+#if MDEFLATE_DEBUG_PRINTF > 2
+			printf("eoff %d\n", i_offset_symbol );
+#endif
+		}
+		else if( i_symbol <= MDEFLATE_MAX_LITERAL_NODE )
+		{
+			i_symbol = ps_compress->pui8_symbols[ ++i_idx ];
+#if MDEFLATE_DEBUG_PRINTF > 2
+		printf("esym2 %d\n", i_symbol );
+#endif
+			if( i_symbol > MDEFLATE_MAX_LITERAL_NODE )
+			{
+				return -1; /* second literal symbol is no literal symbol */
+			}
+			if( ps_compress->i_tree_layout == MDEFLATE_TREE_BYTE )
+			{
+				i_symbol = ( i_symbol << 4 ) | ps_compress->pui8_symbols[ i_idx - 1 ];
+				ui_cw = ps_compress->rgs_byte_nodes[ i_symbol ].i_cw;
+				i_cw_length = ps_compress->rgs_byte_nodes[ i_symbol ].i_cw_length;
+			}
+			else
+			{
+				ui_cw = ( ui_cw << ps_compress->rgs_literal_nodes[ i_symbol ].i_cw_length ) | ps_compress->rgs_literal_nodes[ i_symbol ].i_cw;
+				i_cw_length += ps_compress->rgs_literal_nodes[ i_symbol ].i_cw_length;
+			}
+		}
+		mdeflate_write_bits( ps_compress, ui_cw, i_cw_length );
+	}
+	mdeflate_write_bits( ps_compress, ps_compress->rgs_symbol_nodes[ MDEFLATE_END_OF_BLOCK_NODE ].i_cw, ps_compress->rgs_symbol_nodes[ MDEFLATE_END_OF_BLOCK_NODE ].i_cw_length );
+	mdeflate_flush_bits( ps_compress );
+	return ps_compress->i_bitstream_size;
+}
+
+
+/* writes the parsed symbols from i_first_symbol to i_end_symbol as one block, i_first_extra is the index of
+   their first length or offset extra value. writing stops once the block grows past i_max_size, the returned size
+   is then larger than i_max_size */
+int32_t mdeflate_write_block( mdeflate_compress_t *ps_compress, int32_t i_first_symbol, int32_t i_end_symbol, int32_t i_first_extra, int32_t i_max_size )
+{
+	int32_t i_idx, i_tree_layout, i_max_tree_layout, i_size;
+	int64_t i64_reuse_bits, i64_bits, i64_layout_bits;
+	mdeflate_tables_t s_counted, s_best;
+
+	ps_compress->ui64_cw = 0;
+	ps_compress->i_cw_bits = 0;
+	ps_compress->i_bitstream_size = 0;
+	ps_compress->i_reused_tables = 0;
+
+	mdeflate_count_symbols( ps_compress, i_first_symbol, i_end_symbol );
+	i64_reuse_bits = mdeflate_reuse_bits( ps_compress );
+	if( ps_compress->ps_stats != NULL )
+	{
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
+		{
+			ps_compress->rgi_block_symbol_counts[ i_idx ] = ps_compress->rgs_symbol_nodes[ i_idx ].i_count;
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+		{
+			ps_compress->rgi_block_offset_counts[ i_idx ] = ps_compress->rgs_offset_nodes[ i_idx ].i_count;
+		}
+	}
+
+	/* build the nibble tree layouts and, if allowed, the byte tree and keep the smallest. the legacy format only has the separate one */
+	i_max_tree_layout = ps_compress->s_params.i_byte_literals ? MDEFLATE_TREE_BYTE : MDEFLATE_TREE_SHARED;
+	if( ps_compress->s_format.i_window_log == 0 )
+	{
+		i_max_tree_layout = MDEFLATE_TREE_SEPARATE;
+	}
+	mdeflate_save_tables( ps_compress, &s_counted );
+	i64_bits = mdeflate_build_tables( ps_compress, MDEFLATE_TREE_SEPARATE );
+	ps_compress->i_tree_layout = MDEFLATE_TREE_SEPARATE;
+	for( i_tree_layout = MDEFLATE_TREE_SHARED; i_tree_layout <= i_max_tree_layout; i_tree_layout++ )
+	{
+		mdeflate_save_tables( ps_compress, &s_best );
+		mdeflate_load_tables( ps_compress, &s_counted );
+		i64_layout_bits = mdeflate_build_tables( ps_compress, i_tree_layout );
+		if( i64_bits < 0 || i64_layout_bits < 0 )
+		{
+			return -1;
+		}
+		if( i64_layout_bits < i64_bits )
+		{
+			i64_bits = i64_layout_bits;
+			ps_compress->i_tree_layout = i_tree_layout;
+		}
+		else
+		{
+			mdeflate_load_tables( ps_compress, &s_best );
+		}
+	}
+	i_tree_layout = ps_compress->i_tree_layout;
+
+	MDEFLATE_STAGE_START( ps_compress, MDEFLATE_STAGE_HEADER );
+	if( i64_reuse_bits >= 0 && i64_reuse_bits < i64_bits )
+	{
+		memcpy( ps_compress->rgs_symbol_nodes, ps_compress->rgs_prev_symbol_nodes, sizeof( ps_compress->rgs_symbol_nodes ) );
+		memcpy( ps_compress->rgs_literal_nodes, ps_compress->rgs_prev_literal_nodes, sizeof( ps_compress->rgs_literal_nodes ) );
+		memcpy( ps_compress->rgs_offset_nodes, ps_compress->rgs_prev_offset_nodes, sizeof( ps_compress->rgs_offset_nodes ) );
+		i_tree_layout = ps_compress->i_tree_layout = ps_compress->i_prev_tree_layout;
+		if( i_tree_layout == MDEFLATE_TREE_BYTE )
+		{
+			memcpy( ps_compress->rgs_byte_nodes, ps_compress->rgs_prev_byte_nodes, sizeof( ps_compress->rgs_byte_nodes ) );
+		}
+		mdeflate_write_bits( ps_compress, MDEFLATE_BLOCK_TYPE_REUSE, MDEFLATE_BLOCK_TYPE_BITS );
+		ps_compress->i_reused_tables = 1;
+	}
+	else if( i_tree_layout == MDEFLATE_TREE_BYTE )
+	{
+		mdeflate_write_bits( ps_compress, MDEFLATE_BLOCK_TYPE_BYTE, MDEFLATE_BLOCK_TYPE_BITS );
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_BYTE_BL_NODES; i_idx++ )
+		{
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_idx ].i_cw_length, 3 );
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_BYTE_NODES; i_idx++ )
+		{
+			int32_t i_bl_idx = ps_compress->rgs_byte_nodes[ i_idx ].i_cw_length;
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw_length );
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+		{
+			int32_t i_bl_idx = ps_compress->rgs_offset_nodes[ i_idx ].i_cw_length;
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw_length );
+		}
+	}
+	else
+	{
+		if( i_tree_layout == MDEFLATE_TREE_SHARED )
+		{
+			mdeflate_write_bits( ps_compress, MDEFLATE_BLOCK_TYPE_SHARED, MDEFLATE_BLOCK_TYPE_BITS );
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_BL_NODES; i_idx++ )
+		{
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_idx ].i_cw_length, 3 );
+		}
+
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_SYMBOL_NODES; i_idx++ )
+		{
+			int32_t i_bl_idx = ps_compress->rgs_symbol_nodes[ i_idx ].i_cw_length;
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw_length );
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_LITERAL_NODES && i_tree_layout == MDEFLATE_TREE_SEPARATE; i_idx++ )
+		{
+			int32_t i_bl_idx = ps_compress->rgs_literal_nodes[ i_idx ].i_cw_length;
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw_length );
+		}
+		for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+		{
+			int32_t i_bl_idx = ps_compress->rgs_offset_nodes[ i_idx ].i_cw_length;
+			mdeflate_write_bits( ps_compress, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw, ps_compress->rgs_bl_nodes[ i_bl_idx ].i_cw_length );
+		}
+	}
+
+	ps_compress->i_header_bits = ps_compress->i_bitstream_size * 8 + ps_compress->i_cw_bits;
+	MDEFLATE_STAGE_END( ps_compress, MDEFLATE_STAGE_HEADER );
+
+	MDEFLATE_STAGE_START( ps_compress, MDEFLATE_STAGE_SYMBOLS );
+	i_size = mdeflate_write_symbols( ps_compress, i_first_symbol, i_end_symbol, i_first_extra, i_max_size );
+	MDEFLATE_STAGE_END( ps_compress, MDEFLATE_STAGE_SYMBOLS );
+	return i_size;
+}
+
+
+void mdeflate_init_params( mdeflate_params_t *ps_params, int32_t i_level )
+{
+	if( i_level < MDEFLATE_MIN_LEVEL )
+	{
+		i_level = MDEFLATE_MIN_LEVEL;
+	}
+	else if( i_level > MDEFLATE_MAX_LEVEL )
+	{
+		i_level = MDEFLATE_MAX_LEVEL;
+	}
+	*ps_params = rgs_level_params[ i_level ];
+}
+
+
+void mdeflate_destroy( mdeflate_compress_t *ps_compress )
+{
+	free( ps_compress->ps_optimal );
+	free( ps_compress->pui8_symbols );
+	free( ps_compress->pi_length_and_offset );
+	free( ps_compress->pui8_offset_lut );
+	free( ps_compress->pui_hash_chain );
+	free( ps_compress->pui8_dict );
+	free( ps_compress->pui_dict_hash_head );
+	free( ps_compress );
+}
+
+
+mdeflate_optimal_t *mdeflate_create_optimal( int32_t i_block_size )
+{
+	size_t i_matches;
+	mdeflate_optimal_t *ps_optimal;
+
+	i_matches = ( size_t )i_block_size * MDEFLATE_OPTIMAL_MAX_MATCHES;
+	ps_optimal = malloc( sizeof( mdeflate_optimal_t ) + ( i_matches + 3 * ( i_block_size + 1 ) ) * sizeof( uint32_t ) + ( i_block_size + i_matches + 2 * ( i_block_size + 1 ) ) * sizeof( uint16_t ) );
+	if( ps_optimal == NULL )
+	{
+		return NULL;
+	}
+	ps_optimal->pui_match_offset = ( uint32_t * )( ps_optimal + 1 );
+	ps_optimal->pui_price = ps_optimal->pui_match_offset + i_matches;
+	ps_optimal->pui_step_offset = ps_optimal->pui_price + i_block_size + 1;
+	ps_optimal->pui_parse_offset = ps_optimal->pui_step_offset + i_block_size + 1;
+	ps_optimal->pui16_match_count = ( uint16_t * )( ps_optimal->pui_parse_offset + i_block_size + 1 );
+	ps_optimal->pui16_match_length = ps_optimal->pui16_match_count + i_block_size;
+	ps_optimal->pui16_step_length = ps_optimal->pui16_match_length + i_matches;
+	ps_optimal->pui16_parse_length = ps_optimal->pui16_step_length + i_block_size + 1;
+	return ps_optimal;
+}
+
+
+/* binds the kernels for the MDEFLATE_CPU_* in i_features, the create function passes mdeflate_cpu_features( ) */
+void mdeflate_bind_kernels( mdeflate_compress_t *ps_compress, int32_t i_features )
+{
+	ps_compress->pf_match_length = mdeflate_match_length;
+#if MDEFLATE_DISPATCH
+	if( i_features & MDEFLATE_CPU_SSE2 )
+	{
+		ps_compress->pf_match_length = mdeflate_match_length_sse2;
+	}
+	if( i_features & MDEFLATE_CPU_AVX2 )
+	{
+		ps_compress->pf_match_length = mdeflate_match_length_avx2;
+	}
+#else
+	( void )i_features;
+#endif
+}
+
+
+/* sets up a zeroed context whose format and buffers are in place, returns -1 if the optimal parser buffers can not
+   be allocated */
+int32_t mdeflate_init_ctx( mdeflate_compress_t *ps_compress, const mdeflate_params_t *ps_params )
+{
+	mdeflate_bind_kernels( ps_compress, mdeflate_cpu_features( ) );
+	mdeflate_init_length_and_offset_table( ps_compress );
+
+	ps_compress->s_params = *ps_params;
+	if( ps_compress->s_params.i_max_chain_depth < 1 )
+	{
+		ps_compress->s_params.i_max_chain_depth = 1;
+	}
+	if( ps_compress->s_params.i_nice_match_length < MDEFLATE_MATCH_LENGTH_OFFSET )
+	{
+		ps_compress->s_params.i_nice_match_length = MDEFLATE_MATCH_LENGTH_OFFSET;
+	}
+	if( ps_compress->s_format.i_window_log == 0 )
+	{
+		/* readers of the headerless legacy format only know full huffman blocks with separate literal trees */
+		ps_compress->s_params.i_split_blocks = 0;
+		ps_compress->s_params.i_reuse_tables = 0;
+		ps_compress->s_params.i_byte_literals = 0;
+	}
+
+	if( ps_compress->s_params.i_strategy == MDEFLATE_STRATEGY_OPTIMAL )
+	{
+		ps_compress->ps_optimal = mdeflate_create_optimal( ps_compress->s_format.i_block_size );
+		if( ps_compress->ps_optimal == NULL )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+mdeflate_compress_t *mdeflate_create( const mdeflate_params_t *ps_params )
+{
+	mdeflate_compress_t *ps_compress;
+	mdeflate_format_t *ps_format;
+
+	ps_compress = malloc( sizeof( mdeflate_compress_t ) );
+	if( ps_compress == NULL )
+	{
+		return NULL;
+	}
+	memset( ps_compress, 0, sizeof( mdeflate_compress_t ) );
+
+	ps_format = &ps_compress->s_format;
+	mdeflate_init_format( ps_format, ps_params->i_window_log, ps_params->i_block_log );
+	ps_compress->pui8_symbols = malloc( 2 * ( size_t )ps_format->i_block_size + 1 );
+	ps_compress->pi_length_and_offset = malloc( sizeof( int32_t ) * ( ( size_t )ps_format->i_block_size + 1 ) );
+	ps_compress->pui8_offset_lut = malloc( ps_format->i_window_size );
+	/* room for a second window lets consecutive blocks keep their chains and slide them only every window size bytes */
+	ps_compress->i_hash_chain_size = 2 * ps_format->i_window_size + ps_format->i_block_size;
+	ps_compress->pui_hash_chain = malloc( sizeof( uint32_t ) * ( size_t )ps_compress->i_hash_chain_size );
+	if( ps_compress->pui8_symbols == NULL || ps_compress->pi_length_and_offset == NULL || ps_compress->pui8_offset_lut == NULL || ps_compress->pui_hash_chain == NULL ||
+		mdeflate_init_ctx( ps_compress, ps_params ) < 0 )
+	{
+		mdeflate_destroy( ps_compress );
+		return NULL;
+	}
+	return ps_compress;
+}
+
+
+void mdeflate_reset_block( mdeflate_compress_t *ps_compress )
+{
+	mdeflate_reset_symbols( ps_compress );
+
+	ps_compress->ui64_cw = 0;
+	ps_compress->i_cw_bits = 0;
+	ps_compress->i_bitstream_size = 0;
+}
+
+
+/* also forgets the tables and hash chains of the previous block, the next block carries its own */
+void mdeflate_reset( mdeflate_compress_t *ps_compress )
+{
+	mdeflate_reset_block( ps_compress );
+	ps_compress->pui8_hash_end = NULL;
+	ps_compress->i_have_tables = 0;
+}
+
+
+/* the following blocks add to *ps_stats, NULL stops collecting */
+void mdeflate_set_stats( mdeflate_compress_t *ps_compress, mdeflate_stats_t *ps_stats )
+{
+	ps_compress->ps_stats = ps_stats;
+}
+
+
+/* log2( x ) in 1/256 bits for x > 0, the fraction is looked up from the 6 bits below the leading one */
+int32_t mdeflate_log2_fixed( uint32_t ui_x )
+{
+	int32_t i_log;
+
+#if defined( __GNUC__ )
+	i_log = 31 - __builtin_clz( ui_x );
+#else
+	i_log = 0;
+	while( ( ui_x >> i_log ) > 1 )
+	{
+		i_log++;
+	}
+#endif
+	ui_x = i_log >= 6 ? ui_x >> ( i_log - 6 ) : ui_x << ( 6 - i_log );
+	return ( i_log << 8 ) + rgi_log2_fraction[ ui_x - 64 ];
+}
+
+
+/* estimated huffman coded size of the symbols in 1/256 bits, at least one bit per symbol */
+int64_t mdeflate_estimate_bits( const int32_t *pi_counts, int32_t i_num_nodes )
+{
+	int32_t i_idx, i_total, i_log_total, i_bits;
+	int64_t i64_bits;
+
+	i_total = 0;
+	for( i_idx = 0; i_idx < i_num_nodes; i_idx++ )
+	{
+		i_total += pi_counts[ i_idx ];
+	}
+	if( i_total == 0 )
+	{
+		return 0;
+	}
+	i_log_total = mdeflate_log2_fixed( i_total );
+	i64_bits = 0;
+	for( i_idx = 0; i_idx < i_num_nodes; i_idx++ )
+	{
+		if( pi_counts[ i_idx ] > 0 )
+		{
+			i_bits = i_log_total - mdeflate_log2_fixed( pi_counts[ i_idx ] );
+			i64_bits += ( int64_t )pi_counts[ i_idx ] * ( i_bits < 256 ? 256 : i_bits );
+		}
+	}
+	return i64_bits;
+}
+
+
+int64_t mdeflate_estimate_block_bits( const int32_t *pi_counts, int32_t i_length_bytes )
+{
+	return mdeflate_estimate_bits( pi_counts, MDEFLATE_MAX_SYMBOL_NODES ) +
+		mdeflate_estimate_bits( pi_counts + MDEFLATE_MAX_SYMBOL_NODES, MDEFLATE_MAX_LITERAL_NODES ) +
+		mdeflate_estimate_bits( pi_counts + MDEFLATE_MAX_SYMBOL_NODES + MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_OFFSET_NODES ) +
+		( MDEFLATE_SPLIT_BLOCK_BITS + i_length_bytes * 8 ) * 256;
+}
+
+
+/* guesses from the nibble or byte statistics and the 4 byte repeats in the block and the history before it whether a
+   match search can pay off, returns 1 if the block is better stored right away */
+int32_t mdeflate_probe_stored( uint8_t *pui8_in_data, int32_t i_in_data_length, int32_t i_cb_back, int32_t i_byte_literals )
+{
+	int32_t rgi_counts[ 256 ], rgi_nibble_counts[ 2 * MDEFLATE_MAX_LITERAL_NODES ];
+	uint32_t rgui_recent[ 1 << MDEFLATE_PROBE_HASH_BITS ], ui_value, ui_hash;
+	int32_t i_idx, i_repeats;
+	int64_t i64_bits;
+
+	if( i_in_data_length < MDEFLATE_PROBE_MIN_LENGTH )
+	{
+		return 0;
+	}
+
+	memset( rgi_counts, 0, sizeof( rgi_counts ) );
+	memset( rgi_nibble_counts, 0, sizeof( rgi_nibble_counts ) );
+	for( i_idx = 0; i_idx < i_in_data_length; i_idx++ )
+	{
+		rgi_counts[ pui8_in_data[ i_idx ] ]++;
+	}
+	for( i_idx = 0; i_idx < 256; i_idx++ )
+	{
+		rgi_nibble_counts[ i_idx & 0xf ] += rgi_counts[ i_idx ];
+		rgi_nibble_counts[ MDEFLATE_MAX_LITERAL_NODES + ( i_idx >> 4 ) ] += rgi_counts[ i_idx ];
+	}
+	/* the byte literal estimate is never above the nibble one */
+	if( i_byte_literals )
+	{
+		i64_bits = mdeflate_estimate_bits( rgi_counts, 256 );
+	}
+	else
+	{
+		i64_bits = mdeflate_estimate_bits( rgi_nibble_counts, MDEFLATE_MAX_LITERAL_NODES ) + mdeflate_estimate_bits( rgi_nibble_counts + MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_LITERAL_NODES );
+	}
+	if( i64_bits < ( int64_t )i_in_data_length * MDEFLATE_PROBE_STORED_BITS )
+	{
+		return 0;
+	}
+
+	/* every MDEFLATE_PROBE_STEP-th position of the history and the block is remembered, repeats of at least
+	   MDEFLATE_PROBE_STEP + 3 bytes are found */
+	if( i_cb_back > MDEFLATE_PROBE_STEP << MDEFLATE_PROBE_HASH_BITS )
+	{
+		i_cb_back = MDEFLATE_PROBE_STEP << MDEFLATE_PROBE_HASH_BITS; /* older positions would be overwritten anyway */
+	}
+	memset( rgui_recent, 0, sizeof( rgui_recent ) );
+	for( i_idx = -( i_cb_back & ~( MDEFLATE_PROBE_STEP - 1 ) ); i_idx < 0; i_idx += MDEFLATE_PROBE_STEP )
+	{
+		ui_value = ( uint32_t )mdeflate_read_be( pui8_in_data + i_idx, 4 );
+		rgui_recent[ ( ui_value * 2654435761U ) >> ( 32 - MDEFLATE_PROBE_HASH_BITS ) ] = ui_value;
+	}
+	i_repeats = 0;
+	ui_value = ( uint32_t )mdeflate_read_be( pui8_in_data, 3 );
+	for( i_idx = 0; i_idx + 3 < i_in_data_length; i_idx++ )
+	{
+		ui_value = ( ui_value << 8 ) | pui8_in_data[ i_idx + 3 ];
+		ui_hash = ( ui_value * 2654435761U ) >> ( 32 - MDEFLATE_PROBE_HASH_BITS );
+		if( rgui_recent[ ui_hash ] == ui_value )
+		{
+			i_repeats++;
+		}
+		if( ( i_idx & ( MDEFLATE_PROBE_STEP - 1 ) ) == 0 )
+		{
+			rgui_recent[ ui_hash ] = ui_value;
+		}
+	}
+	return i_repeats * MDEFLATE_PROBE_REPEAT_RATE <= i_in_data_length;
+}
+
+
+/* returns 1 if the block was not parsed because it is better stored */
+int32_t mdeflate_parse( mdeflate_compress_t *ps_compress, uint8_t *pui8_in_data, int32_t i_in_data_length, int32_t i_cb_back )
+{
+	if( i_in_data_length > ps_compress->s_format.i_block_size )
+	{
+		return -1;
+	}
+	mdeflate_reset_block( ps_compress );
+
+	if( i_cb_back > ps_compress->i_max_codebook_back )
+	{
+		i_cb_back = ps_compress->i_max_codebook_back;
+	}
+	if( pui8_in_data - i_cb_back == ps_compress->pui8_dict && ps_compress->i_dict_hash_pos > 0 )
+	{
+		ps_compress->pui8_window = ps_compress->pui8_dict;
+		memcpy( ps_compress->rgui_hash_head, ps_compress->pui_dict_hash_head, sizeof( ps_compress->rgui_hash_head ) );
+		ps_compress->i_hash_pos = ps_compress->i_dict_hash_pos;
+	}
+	else if( pui8_in_data == ps_compress->pui8_hash_end && pui8_in_data - i_cb_back >= ps_compress->pui8_window )
+	{
+		/* the block follows the last one in memory, keep hashing into its chains */
+		if( pui8_in_data + i_in_data_length - ps_compress->pui8_window > ps_compress->i_hash_chain_size )
+		{
+			mdeflate_slide_hash( ps_compress, ( int32_t )( pui8_in_data - ps_compress->i_max_codebook_back - ps_compress->pui8_window ) );
+		}
+		ps_compress->i_dict_hash_pos = 0;
+	}
+	else
+	{
+		ps_compress->pui8_window = pui8_in_data - i_cb_back;
+		ps_compress->i_hash_pos = 0;
+		memset( ps_compress->rgui_hash_head, 0, sizeof( ps_compress->rgui_hash_head ) );
+		ps_compress->i_dict_hash_pos = 0;
+	}
+	ps_compress->i_codebook_back = ( int32_t )( pui8_in_data - ps_compress->pui8_window );
+	ps_compress->i_min_match_pos = ps_compress->i_codebook_back - i_cb_back;
+	ps_compress->pui8_hash_end = pui8_in_data + i_in_data_length;
+
+	MDEFLATE_STAGE_START( ps_compress, MDEFLATE_STAGE_MATCH );
+	if( ps_compress->s_params.i_strategy == MDEFLATE_STRATEGY_STORE )
+	{
+		mdeflate_parse_store( ps_compress, i_in_data_length );
+	}
+	else if( ps_compress->s_format.i_window_log != 0 && mdeflate_probe_stored( pui8_in_data, i_in_data_length, i_cb_back, ps_compress->s_params.i_byte_literals ) )
+	{
+		MDEFLATE_STAGE_END( ps_compress, MDEFLATE_STAGE_MATCH );
+		return 1;
+	}
+	else if( ps_compress->s_params.i_strategy == MDEFLATE_STRATEGY_OPTIMAL )
+	{
+		mdeflate_parse_optimal( ps_compress, i_in_data_length );
+	}
+	else if( ps_compress->s_params.i_strategy == MDEFLATE_STRATEGY_GREEDY )
+	{
+		mdeflate_parse_lazy( ps_compress, i_in_data_length, 0 );
+	}
+	else if( ps_compress->s_params.i_strategy == MDEFLATE_STRATEGY_DEEP_LAZY )
+	{
+		mdeflate_parse_lazy( ps_compress, i_in_data_length, 2 );
+	}
+	else
+	{
+		mdeflate_parse_lazy( ps_compress, i_in_data_length, 1 );
+	}
+	MDEFLATE_STAGE_END( ps_compress, MDEFLATE_STAGE_MATCH );
+	return 0;
+}
+
+
+int64_t mdeflate_estimate_merge_bits( const int32_t *pi_counts_a, const int32_t *pi_counts_b, int32_t i_length_bytes )
+{
+	int32_t rgi_merged[ MDEFLATE_SPLIT_NODES ], i_idx;
+
+	for( i_idx = 0; i_idx < MDEFLATE_SPLIT_NODES; i_idx++ )
+	{
+		rgi_merged[ i_idx ] = pi_counts_a[ i_idx ] + pi_counts_b[ i_idx ];
+	}
+	return mdeflate_estimate_block_bits( rgi_merged, i_length_bytes );
+}
+
+
+/* cuts the parsed block into segments of about equal input size, collects their symbol histograms and keeps the cuts
+   where the estimated bits saved by new tables are more than the cost of another block. the cuts are returned as
+   symbol and extra value indices and input positions, the function returns the number of blocks */
+int32_t mdeflate_split_block( mdeflate_compress_t *ps_compress, int32_t i_in_data_length, int32_t *pi_cut_symbol, int32_t *pi_cut_extra, int32_t *pi_cut_pos )
+{
+	int32_t rgi_counts[ MDEFLATE_SPLIT_SEGMENTS ][ MDEFLATE_SPLIT_NODES ];
+	int32_t rgi_segment_symbol[ MDEFLATE_SPLIT_SEGMENTS + 1 ], rgi_segment_extra[ MDEFLATE_SPLIT_SEGMENTS + 1 ], rgi_segment_pos[ MDEFLATE_SPLIT_SEGMENTS + 1 ];
+	int32_t rgi_first[ MDEFLATE_SPLIT_SEGMENTS + 1 ];
+	int64_t rgi64_bits[ MDEFLATE_SPLIT_SEGMENTS ], rgi64_merge[ MDEFLATE_SPLIT_SEGMENTS ];
+	int32_t i_segments, i_segment, i_first, i_best, i_idx, i_pos, i_next_pos, i_extra, i_symbol, i_num_blocks, i_length_bytes;
+
+	i_segments = i_in_data_length / MDEFLATE_SPLIT_MIN_SEGMENT;
+	if( i_segments > MDEFLATE_SPLIT_SEGMENTS )
+	{
+		i_segments = MDEFLATE_SPLIT_SEGMENTS;
+	}
+	if( !ps_compress->s_params.i_split_blocks || i_segments < 2 )
+	{
+		pi_cut_symbol[ 0 ] = pi_cut_extra[ 0 ] = pi_cut_pos[ 0 ] = 0;
+		pi_cut_symbol[ 1 ] = ps_compress->i_symbol_count;
+		pi_cut_extra[ 1 ] = ps_compress->i_length_and_offset_count;
+		pi_cut_pos[ 1 ] = i_in_data_length;
+		return 1;
+	}
+
+	i_length_bytes = ps_compress->s_format.i_length_bytes;
+	memset( rgi_counts, 0, sizeof( rgi_counts ) );
+	rgi_segment_symbol[ 0 ] = rgi_segment_extra[ 0 ] = rgi_segment_pos[ 0 ] = 0;
+	i_segment = i_pos = i_extra = 0;
+	i_next_pos = i_in_data_length / i_segments;
+	for( i_idx = 0; i_idx < ps_compress->i_symbol_count; i_idx += 2 )
+	{
+		while( i_pos >= i_next_pos )
+		{
+			i_segment++;
+			rgi_segment_symbol[ i_segment ] = i_idx;
+			rgi_segment_extra[ i_segment ] = i_extra;
+			rgi_segment_pos[ i_segment ] = i_pos;
+			i_next_pos = i_segment + 1 < i_segments ? ( i_segment + 1 ) * ( i_in_data_length / i_segments ) : i_in_data_length;
+		}
+		i_symbol = ps_compress->pui8_symbols[ i_idx ];
+		rgi_counts[ i_segment ][ i_symbol ]++;
+		if( i_symbol > MDEFLATE_END_OF_BLOCK_NODE )
+		{
+			rgi_counts[ i_segment ][ MDEFLATE_MAX_SYMBOL_NODES + MDEFLATE_MAX_LITERAL_NODES + ps_compress->pui8_symbols[ i_idx + 1 ] ]++;
+			i_pos += ps_compress->rgui_length_offset[ i_symbol - MDEFLATE_LENGTH_NODES_OFFSET ] + ps_compress->pi_length_and_offset[ i_extra ] + MDEFLATE_MATCH_LENGTH_OFFSET;
+			i_extra += 2;
+		}
+		else
+		{
+			rgi_counts[ i_segment ][ MDEFLATE_MAX_SYMBOL_NODES + ps_compress->pui8_symbols[ i_idx + 1 ] ]++;
+			i_pos++;
+		}
+	}
+	while( i_segment + 1 < i_segments )
+	{
+		i_segment++;
+		rgi_segment_symbol[ i_segment ] = ps_compress->i_symbol_count;
+		rgi_segment_extra[ i_segment ] = i_extra;
+		rgi_segment_pos[ i_segment ] = i_pos;
+	}
+	rgi_segment_symbol[ i_segments ] = ps_compress->i_symbol_count;
+	rgi_segment_extra[ i_segments ] = i_extra;
+	rgi_segment_pos[ i_segments ] = i_pos;
+
+	/* start with one block per segment and merge the neighbours whose shared tables save the most until no merge saves bits */
+	for( i_segment = 0; i_segment < i_segments; i_segment++ )
+	{
+		rgi_first[ i_segment ] = i_segment;
+		rgi64_bits[ i_segment ] = mdeflate_estimate_block_bits( rgi_counts[ i_segment ], i_length_bytes );
+	}
+	rgi_first[ i_segments ] = i_segments;
+	for( i_segment = 0; i_segment < i_segments - 1; i_segment++ )
+	{
+		rgi64_merge[ i_segment ] = mdeflate_estimate_merge_bits( rgi_counts[ i_segment ], rgi_counts[ i_segment + 1 ], i_length_bytes ) - rgi64_bits[ i_segment ] - rgi64_bits[ i_segment + 1 ];
+	}
+	i_num_blocks = i_segments;
+	while( i_num_blocks > 1 )
+	{
+		i_best = 0;
+		for( i_idx = 1; i_idx < i_num_blocks - 1; i_idx++ )
+		{
+			if( rgi64_merge[ i_idx ] < rgi64_merge[ i_best ] )
+			{
+				i_best = i_idx;
+			}
+		}
+		if( rgi64_merge[ i_best ] > 0 )
+		{
+			break;
+		}
+		i_first = rgi_first[ i_best ];
+		i_segment = rgi_first[ i_best + 1 ];
+		for( i_idx = 0; i_idx < MDEFLATE_SPLIT_NODES; i_idx++ )
+		{
+			rgi_counts[ i_first ][ i_idx ] += rgi_counts[ i_segment ][ i_idx ];
+		}
+		rgi64_bits[ i_best ] += rgi64_bits[ i_best + 1 ] + rgi64_merge[ i_best ];
+		i_num_blocks--;
+		for( i_idx = i_best + 1; i_idx < i_num_blocks; i_idx++ )
+		{
+			rgi_first[ i_idx ] = rgi_first[ i_idx + 1 ];
+			rgi64_bits[ i_idx ] = rgi64_bits[ i_idx + 1 ];
+			rgi64_merge[ i_idx ] = rgi64_merge[ i_idx + 1 ];
+		}
+		rgi_first[ i_num_blocks ] = rgi_first[ i_num_blocks + 1 ];
+		if( i_best > 0 )
+		{
+			rgi64_merge[ i_best - 1 ] = mdeflate_estimate_merge_bits( rgi_counts[ rgi_first[ i_best - 1 ] ], rgi_counts[ i_first ], i_length_bytes ) - rgi64_bits[ i_best - 1 ] - rgi64_bits[ i_best ];
+		}
+		if( i_best < i_num_blocks - 1 )
+		{
+			rgi64_merge[ i_best ] = mdeflate_estimate_merge_bits( rgi_counts[ i_first ], rgi_counts[ rgi_first[ i_best + 1 ] ], i_length_bytes ) - rgi64_bits[ i_best ] - rgi64_bits[ i_best + 1 ];
+		}
+	}
+
+	for( i_idx = 0; i_idx <= i_num_blocks; i_idx++ )
+	{
+		pi_cut_symbol[ i_idx ] = rgi_segment_symbol[ rgi_first[ i_idx ] ];
+		pi_cut_extra[ i_idx ] = rgi_segment_extra[ rgi_first[ i_idx ] ];
+		pi_cut_pos[ i_idx ] = rgi_segment_pos[ rgi_first[ i_idx ] ];
+	}
+	return i_num_blocks;
+}
+
+
+void mdeflate_stats_add_block( mdeflate_stats_t *ps_stats, int32_t i_block_type, int32_t i_uncompressed, int32_t i_compressed, int32_t i_header_bits )
+{
+	ps_stats->rgi64_blocks[ i_block_type ]++;
+	ps_stats->i64_uncompressed_bytes += i_uncompressed;
+	ps_stats->i64_compressed_bytes += i_compressed;
+	ps_stats->i64_header_bits += i_header_bits;
+	ps_stats->i64_payload_bits += ( int64_t )i_compressed * 8 - i_header_bits;
+}
+
+
+int32_t mdeflate_tree_limited( encnode_t *ps_nodes, int32_t i_num_nodes, int32_t i_max_cw_length )
+{
+	int32_t i_node;
+
+	for( i_node = 0; i_node < i_num_nodes; i_node++ )
+	{
+		if( ps_nodes[ i_node ].i_cw_length >= i_max_cw_length )
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/* adds the huffman block just written, its symbol counts were taken before the trees were built */
+void mdeflate_stats_add_symbols( mdeflate_compress_t *ps_compress, int32_t i_in_data_length )
+{
+	mdeflate_stats_t *ps_stats;
+	int32_t i_idx, i_literals, i_block_type;
+
+	ps_stats = ps_compress->ps_stats;
+	i_literals = 0;
+	for( i_idx = 0; i_idx <= MDEFLATE_MAX_LITERAL_NODE; i_idx++ )
+	{
+		i_literals += ps_compress->rgi_block_symbol_counts[ i_idx ];
+	}
+	for( i_idx = 0; i_idx < MDEFLATE_MAX_LENGTH_NODES; i_idx++ )
+	{
+		ps_stats->rgi64_length_symbols[ i_idx ] += ps_compress->rgi_block_symbol_counts[ MDEFLATE_LENGTH_NODES_OFFSET + i_idx ];
+		ps_stats->i64_matches += ps_compress->rgi_block_symbol_counts[ MDEFLATE_LENGTH_NODES_OFFSET + i_idx ];
+	}
+	for( i_idx = 0; i_idx < MDEFLATE_MAX_OFFSET_NODES; i_idx++ )
+	{
+		ps_stats->rgi64_offset_symbols[ i_idx ] += ps_compress->rgi_block_offset_counts[ i_idx ];
+	}
+	ps_stats->i64_literals += i_literals;
+	ps_stats->i64_match_bytes += i_in_data_length - i_literals;
+
+	if( ps_compress->i_reused_tables )
+	{
+		i_block_type = MDEFLATE_BLOCK_TYPE_REUSE;
+	}
+	else
+	{
+		i_block_type = ps_compress->i_tree_layout == MDEFLATE_TREE_BYTE ? MDEFLATE_BLOCK_TYPE_BYTE : ( ps_compress->i_tree_layout == MDEFLATE_TREE_SHARED ? MDEFLATE_BLOCK_TYPE_SHARED : MDEFLATE_BLOCK_TYPE_SEPARATE );
+		if( i_block_type == MDEFLATE_BLOCK_TYPE_BYTE )
+		{
+			ps_stats->i64_limited_trees += mdeflate_tree_limited( ps_compress->rgs_byte_nodes, MDEFLATE_MAX_BYTE_NODES, MDEFLATE_MAX_BYTE_CW_LENGTH );
+		}
+		else
+		{
+			ps_stats->i64_limited_trees += mdeflate_tree_limited( ps_compress->rgs_symbol_nodes, MDEFLATE_MAX_SYMBOL_NODES, MDEFLATE_MAX_CW_LENGTH );
+			if( i_block_type == MDEFLATE_BLOCK_TYPE_SEPARATE )
+			{
+				ps_stats->i64_limited_trees += mdeflate_tree_limited( ps_compress->rgs_literal_nodes, MDEFLATE_MAX_LITERAL_NODES, MDEFLATE_MAX_CW_LENGTH );
+			}
+		}
+		ps_stats->i64_limited_trees += mdeflate_tree_limited( ps_compress->rgs_offset_nodes, MDEFLATE_MAX_OFFSET_NODES, MDEFLATE_MAX_CW_LENGTH );
+	}
+	mdeflate_stats_add_block( ps_stats, i_block_type, i_in_data_length, ps_compress->i_bitstream_size, ps_compress->i_header_bits );
+}
+
+
+int32_t mdeflate_write_stored( mdeflate_compress_t *ps_compress, uint8_t *pui8_in_data, int32_t i_in_data_length )
+{
+	memset( ps_compress->pui8_bitstream, 0, MDEFLATE_STORED_BLOCK_HEADER );
+	memcpy( ps_compress->pui8_bitstream + MDEFLATE_STORED_BLOCK_HEADER, pui8_in_data, i_in_data_length );
+	ps_compress->i_bitstream_size = i_in_data_length + MDEFLATE_STORED_BLOCK_HEADER;
+	if( ps_compress->ps_stats != NULL )
+	{
+		mdeflate_stats_add_block( ps_compress->ps_stats, MDEFLATE_BLOCK_TYPE_STORED, i_in_data_length, ps_compress->i_bitstream_size, MDEFLATE_STORED_BLOCK_HEADER * 8 );
+		ps_compress->ps_stats->i64_literals += i_in_data_length;
+	}
+	return ps_compress->i_bitstream_size;
+}
+
+
+/* writes the parsed symbols covering i_in_data_length bytes of input as a huffman block or, if that is not smaller, as a stored block.
+   the legacy format has no stored blocks, its huffman blocks always fit into the block bound */
+int32_t mdeflate_write_block_or_stored( mdeflate_compress_t *ps_compress, int32_t i_first_symbol, int32_t i_end_symbol, int32_t i_first_extra, uint8_t *pui8_in_data, int32_t i_in_data_length )
+{
+	int32_t i_bitstream_size, i_max_size;
+
+	i_max_size = ps_compress->s_format.i_window_log == 0 ? ps_compress->s_format.i_enc_block_bound : i_in_data_length + MDEFLATE_STORED_BLOCK_HEADER - 1;
+	i_bitstream_size = mdeflate_write_block( ps_compress, i_first_symbol, i_end_symbol, i_first_extra, i_max_size );
+	if( ps_compress->s_format.i_window_log != 0 && i_bitstream_size >= i_in_data_length + MDEFLATE_STORED_BLOCK_HEADER )
+	{
+		return mdeflate_write_stored( ps_compress, pui8_in_data, i_in_data_length );
+	}
+	if( i_bitstream_size >= 0 )
+	{
+		mdeflate_keep_tables( ps_compress );
+		if( ps_compress->ps_stats != NULL )
+		{
+			mdeflate_stats_add_symbols( ps_compress, i_in_data_length );
+		}
+	}
+	return i_bitstream_size;
+}
+
+
+int32_t mdeflate_enc_block_ctx( mdeflate_compress_t *ps_compress, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back )
+{
+	int32_t i_parsed;
+
+	i_parsed = mdeflate_parse( ps_compress, pui8_in_data, i_in_data_length, i_cb_back );
+	if( i_parsed < 0 )
+	{
+		return -1;
+	}
+	ps_compress->pui8_bitstream = pui8_out_data;
+	if( i_parsed > 0 )
+	{
+		return mdeflate_write_stored( ps_compress, pui8_in_data, i_in_data_length );
+	}
+	return mdeflate_write_block_or_stored( ps_compress, 0, ps_compress->i_symbol_count, 0, pui8_in_data, i_in_data_length );
+}
+
+
+/* compresses up to one block of input into one or more length prefixed blocks and returns their total size */
+int32_t mdeflate_enc_blocks_ctx( mdeflate_compress_t *ps_compress, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back )
+{
+	int32_t rgi_cut_symbol[ MDEFLATE_SPLIT_SEGMENTS + 1 ], rgi_cut_extra[ MDEFLATE_SPLIT_SEGMENTS + 1 ], rgi_cut_pos[ MDEFLATE_SPLIT_SEGMENTS + 1 ];
+	int32_t i_parsed, i_num_blocks, i_block, i_out_size, i_edata_size, i_length_bytes;
+
+	i_parsed = mdeflate_parse( ps_compress, pui8_in_data, i_in_data_length, i_cb_back );
+	if( i_parsed < 0 )
+	{
+		return -1;
+	}
+	i_length_bytes = ps_compress->s_format.i_length_bytes;
+	if( i_parsed > 0 )
+	{
+		ps_compress->pui8_bitstream = pui8_out_data + i_length_bytes;
+		i_edata_size = mdeflate_write_stored( ps_compress, pui8_in_data, i_in_data_length );
+		mdeflate_write_be( pui8_out_data, i_edata_size, i_length_bytes );
+		return i_edata_size + i_length_bytes;
+	}
+	i_num_blocks = mdeflate_split_block( ps_compress, i_in_data_length, rgi_cut_symbol, rgi_cut_extra, rgi_cut_pos );
+
+	i_out_size = 0;
+	for( i_block = 0; i_block < i_num_blocks; i_block++ )
+	{
+		ps_compress->pui8_bitstream = pui8_out_data + i_out_size + i_length_bytes;
+		i_edata_size = mdeflate_write_block_or_stored( ps_compress, rgi_cut_symbol[ i_block ], rgi_cut_symbol[ i_block + 1 ], rgi_cut_extra[ i_block ],
+			pui8_in_data + rgi_cut_pos[ i_block ], rgi_cut_pos[ i_block + 1 ] - rgi_cut_pos[ i_block ] );
+		if( i_edata_size < 0 )
+		{
+			return -1;
+		}
+		mdeflate_write_be( pui8_out_data + i_out_size, i_edata_size, i_length_bytes );
+		i_out_size += i_edata_size + i_length_bytes;
+	}
+	return i_out_size;
+}
+
+
+/* the legacy format is small enough to keep the context and its buffers on the stack like before the context API,
+   so one-shot calls do not allocate. a fresh context hashes at most the window of 6998 bytes and a block */
+int32_t mdeflate_enc_block_legacy( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back, const mdeflate_params_t *ps_params )
+{
+	int32_t i_bitstream_size;
+	mdeflate_compress_t s_compress;
+	uint8_t rgui8_symbols[ MDEFLATE_BLOCK_SIZE + 1 ];
+	int32_t rgi_length_and_offset[ MDEFLATE_BLOCK_SIZE / 2 + 1 ];
+	uint8_t rgui8_offset_lut[ MDEFLATE_BLOCK_SIZE / 2 ];
+	uint32_t rgui_hash_chain[ MDEFLATE_BLOCK_SIZE ];
+
+	memset( &s_compress, 0, sizeof( mdeflate_compress_t ) );
+	mdeflate_init_format( &s_compress.s_format, 0, 0 );
+	s_compress.pui8_symbols = &rgui8_symbols[ 0 ];
+	s_compress.pi_length_and_offset = &rgi_length_and_offset[ 0 ];
+	s_compress.pui8_offset_lut = &rgui8_offset_lut[ 0 ];
+	s_compress.pui_hash_chain = &rgui_hash_chain[ 0 ];
+	s_compress.i_hash_chain_size = MDEFLATE_BLOCK_SIZE;
+	if( mdeflate_init_ctx( &s_compress, ps_params ) < 0 )
+	{
+		return -1;
+	}
+	i_bitstream_size = mdeflate_enc_block_ctx( &s_compress, pui8_in_data, i_in_data_length, pui8_out_data, i_cb_back );
+	free( s_compress.ps_optimal );
+
+	return i_bitstream_size;
+}
+
+
+int32_t mdeflate_enc_block_params( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back, const mdeflate_params_t *ps_params )
+{
+	int32_t i_bitstream_size;
+	mdeflate_compress_t *ps_compress;
+
+	if( ps_params->i_window_log == 0 && ps_params->i_block_log == 0 )
+	{
+		return mdeflate_enc_block_legacy( pui8_in_data, i_in_data_length, pui8_out_data, i_cb_back, ps_params );
+	}
+	ps_compress = mdeflate_create( ps_params );
+	if( ps_compress == NULL )
+	{
+		return -1;
+	}
+	i_bitstream_size = mdeflate_enc_block_ctx( ps_compress, pui8_in_data, i_in_data_length, pui8_out_data, i_cb_back );
+	mdeflate_destroy( ps_compress );
+
+	return i_bitstream_size;
+}
+
+
+int32_t mdeflate_enc_block( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back )
+{
+	mdeflate_params_t s_params;
+
+	mdeflate_init_params( &s_params, MDEFLATE_DEFAULT_LEVEL );
+	return mdeflate_enc_block_params( pui8_in_data, i_in_data_length, pui8_out_data, i_cb_back, &s_params );
+}
+
+
+/* hashes the dictionary once so messages only search it. the last two positions hash bytes of the message and are
+   inserted with it */
+void mdeflate_hash_dict( mdeflate_compress_t *ps_compress )
+{
+	ps_compress->pui8_window = ps_compress->pui8_dict;
+	ps_compress->pui8_hash_end = NULL;
+	ps_compress->i_hash_pos = 0;
+	memset( ps_compress->rgui_hash_head, 0, sizeof( ps_compress->rgui_hash_head ) );
+	mdeflate_hash_insert_to( ps_compress, ps_compress->i_dict_length - 2 );
+	memcpy( ps_compress->pui_dict_hash_head, ps_compress->rgui_hash_head, sizeof( ps_compress->rgui_hash_head ) );
+	ps_compress->i_dict_hash_pos = ps_compress->i_hash_pos;
+}
+
+
+/* sets the preset dictionary for mdeflate_enc_block_dict, only the last window size bytes are kept. returns -1 if out of memory */
+int32_t mdeflate_set_dict( mdeflate_compress_t *ps_compress, const uint8_t *pui8_dict, int32_t i_dict_length )
+{
+	if( ps_compress->pui8_dict == NULL )
+	{
+		ps_compress->pui8_dict = malloc( ( size_t )ps_compress->i_max_codebook_back + ps_compress->s_format.i_block_size );
+		ps_compress->pui_dict_hash_head = malloc( sizeof( ps_compress->rgui_hash_head ) );
+		if( ps_compress->pui8_dict == NULL || ps_compress->pui_dict_hash_head == NULL )
+		{
+			free( ps_compress->pui8_dict );
+			free( ps_compress->pui_dict_hash_head );
+			ps_compress->pui8_dict = NULL;
+			ps_compress->pui_dict_hash_head = NULL;
+			return -1;
+		}
+	}
+	if( i_dict_length > ps_compress->i_max_codebook_back )
+	{
+		pui8_dict += i_dict_length - ps_compress->i_max_codebook_back;
+		i_dict_length = ps_compress->i_max_codebook_back;
+	}
+	memcpy( ps_compress->pui8_dict, pui8_dict, i_dict_length );
+	ps_compress->i_dict_length = i_dict_length;
+	mdeflate_hash_dict( ps_compress );
+	return 0;
+}
+
+
+/* compresses a message of up to one block into a single block that references the preset dictionary. every
+   message is decoded on its own, so no tables are reused */
+int32_t mdeflate_enc_block_dict( mdeflate_compress_t *ps_compress, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data )
+{
+	if( ps_compress->pui8_dict == NULL || i_in_data_length > ps_compress->s_format.i_block_size )
+	{
+		return -1;
+	}
+	if( ps_compress->i_dict_hash_pos == 0 )
+	{
+		mdeflate_hash_dict( ps_compress );
+	}
+	memcpy( ps_compress->pui8_dict + ps_compress->i_dict_length, pui8_in_data, i_in_data_length );
+	ps_compress->i_have_tables = 0;
+	return mdeflate_enc_block_ctx( ps_compress, ps_compress->pui8_dict + ps_compress->i_dict_length, i_in_data_length, pui8_out_data, ps_compress->i_dict_length );
+}
+
+
+
+/* ------------------------ UNCOMPRESS ------------------------ */
+
+typedef struct minflate_uncompress_s {
+	mdeflate_format_t s_format;
+	int32_t i_have_tables; /* the luts hold the tables of the last huffman block */
+	int32_t i_byte_tree; /* the last huffman block coded whole literal bytes */
+
+#if WITH_WIDE_BIT_READER
+	int32_t i_bits;
+	uint64_t ui64_cw;
+	uint8_t *pui8_bitstream;
+	uint8_t *pui8_bitstream_end;
+#else
+	int8_t i8_bits;
+	uint16_t ui16_cw;
+	uint8_t *pui8_bitstream;
+#endif
+
+	uint8_t ui8_out_slot;
+	uint8_t *pui8_out;
+	uint8_t *pui8_out_end;
+	uint8_t *pui8_dict; /* matches reaching before the output of a block continue at the end of the preset dictionary */
+	int32_t i_dict_length;
+
+	uint8_t rgui8_symbol_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
+	uint8_t rgui8_symbol_length_lut[ MDEFLATE_MAX_SYMBOL_NODES ];
+	uint8_t rgui8_literal_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
+	uint8_t rgui8_literal_length_lut[ MDEFLATE_MAX_LITERAL_NODES ];
+	uint8_t *pui8_literal_lut; /* the literal or, for blocks with a shared tree, the symbol luts */
+	uint8_t *pui8_literal_length_lut;
+	uint8_t rgui8_offset_lut[ 1 << MDEFLATE_MAX_CW_LENGTH ];
+	uint8_t rgui8_offset_length_lut[ MDEFLATE_MAX_OFFSET_NODES ];
+
+	const int32_t *pi_offset_extra;
+	uint32_t rgui_offset_offset[ MDEFLATE_MAX_OFFSET_NODES ];
+	uint8_t rgui8_length_offset[ MDEFLATE_MAX_SYMBOL_NODES ];
+
+#if WITH_BYTE_LITERALS
+	/* symbol and code length above MINFLATE_BYTE_LENGTH_SHIFT or MINFLATE_BYTE_LUT_LINK and the start of the second level table */
+	uint16_t rgui16_byte_lut[ MINFLATE_BYTE_LUT_SIZE ];
+	uint8_t rgui8_byte_length_lut[ MDEFLATE_MAX_BYTE_NODES ];
+#endif
+
+#if MINFLATE_PAIR_LUT
+	/* whole literal byte in the low 8 bits and the summed code length of both nibbles above, 0 if the codes do not fit */
+	uint16_t rgui16_pair_lut[ 1 << MINFLATE_PAIR_LUT_BITS ];
+#endif
+	mdeflate_stats_t *ps_stats;
+	int32_t ( *pf_decode_symbols )( struct minflate_uncompress_s *ps_uncompress, uint8_t *pui8_out_data, int32_t *pi_match_bytes );
+} minflate_uncompress_t;
+
+
+#if WITH_WIDE_BIT_READER
+
+uint64_t minflate_load_be64( uint8_t *pui8_data )
+{
+	uint64_t ui64_value;
+#if defined( __GNUC__ ) && defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	memcpy( &ui64_value, pui8_data, sizeof( ui64_value ) );
+	ui64_value = __builtin_bswap64( ui64_value );
+#elif defined( __BYTE_ORDER__ ) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	memcpy( &ui64_value, pui8_data, sizeof( ui64_value ) );
+#else
+	int32_t i_idx;
+	ui64_value = 0;
+	for( i_idx = 0; i_idx < 8; i_idx++ )
+	{
+		ui64_value = ( ui64_value << 8 ) | pui8_data[ i_idx ];
+	}
+#endif
+	return ui64_value;
+}
+
+
+/* tops the bit buffer up to at least 56 bits. the single load may touch bytes
+   past the last one consumed but never past the end of the block, near the end
+   bytes are fed one by one and zeros are shifted in after it */
+MDEFLATE_KERNEL void minflate_refill( minflate_uncompress_t *ps_uncompress )
+{
+	if( ps_uncompress->pui8_bitstream + 8 <= ps_uncompress->pui8_bitstream_end )
+	{
+		ps_uncompress->ui64_cw |= minflate_load_be64( ps_uncompress->pui8_bitstream ) >> ps_uncompress->i_bits;
+		ps_uncompress->pui8_bitstream += ( 63 - ps_uncompress->i_bits ) >> 3;
+		ps_uncompress->i_bits |= 56;
+	}
+	else
+	{
+		while( ps_uncompress->i_bits <= 56 )
+		{
+			if( ps_uncompress->pui8_bitstream < ps_uncompress->pui8_bitstream_end )
+			{
+				ps_uncompress->ui64_cw |= ( ( uint64_t )*( ps_uncompress->pui8_bitstream++ ) ) << ( 56 - ps_uncompress->i_bits );
+			}
+			ps_uncompress->i_bits += 8;
+		}
+	}
+}
+
+
+/* the take functions do not refill, the caller makes sure enough bits are buffered */
+MDEFLATE_KERNEL uint32_t minflate_take_bits( minflate_uncompress_t *ps_uncompress, int32_t i_length )
+{
+	uint32_t ui_cw;
+	ui_cw = ( uint32_t )( ( ps_uncompress->ui64_cw >> 1 ) >> ( 63 - i_length ) );
+	ps_uncompress->ui64_cw <<= i_length;
+	ps_uncompress->i_bits -= i_length;
+	return ui_cw;
+}
+
+
+MDEFLATE_KERNEL uint8_t minflate_take_symbol( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_node_lut, uint8_t *pui8_node_length_lut )
+{
+	uint8_t ui8_sym, ui8_len;
+
+	ui8_sym = pui8_node_lut[ ps_uncompress->ui64_cw >> 56 ];
+	ui8_len = pui8_node_length_lut[ ui8_sym ];
+	ps_uncompress->ui64_cw <<= ui8_len;
+	ps_uncompress->i_bits -= ui8_len;
+
+	return ui8_sym;
+}
+
+
+MDEFLATE_KERNEL uint32_t minflate_read_bits( minflate_uncompress_t *ps_uncompress, uint8_t ui8_length )
+{
+	if( ps_uncompress->i_bits < ui8_length )
+	{
+		minflate_refill( ps_uncompress );
+	}
+	return minflate_take_bits( ps_uncompress, ui8_length );
+}
+
+#else
+
+/* at least 8 bits are buffered, longer offset extra bits are read in two parts */
+uint32_t minflate_read_bits( minflate_uncompress_t *ps_uncompress, uint8_t ui8_length )
+{
+	uint8_t ui8_cw;
+	if( ui8_length > 8 )
+	{
+		ui8_cw = ( uint8_t )minflate_read_bits( ps_uncompress, ui8_length - 8 );
+		return ( ( uint32_t )ui8_cw << 8 ) | minflate_read_bits( ps_uncompress, 8 );
+	}
+	ui8_cw = ps_uncompress->ui16_cw >> ( 16 - ui8_length );
+	ps_uncompress->ui16_cw <<= ui8_length;
+	ps_uncompress->i8_bits -= ui8_length;
+	if( ps_uncompress->i8_bits < 0 )
+	{
+		ps_uncompress->ui16_cw |= ( *( ps_uncompress->pui8_bitstream++ ) ) << ( -ps_uncompress->i8_bits );
+		ps_uncompress->i8_bits += 8;
+	}
+	return ui8_cw;
+}
+
+#endif
+
+
+void minflate_init_length_and_offset_table( minflate_uncompress_t *ps_uncompress )
+{
+	int32_t i_symbol_idx, i_symbol_offset;
+
+	i_symbol_offset = 0;
+	for( i_symbol_idx = 0; i_symbol_idx < MDEFLATE_MAX_OFFSET_NODES; i_symbol_idx++ )
+	{
+		ps_uncompress->rgui_offset_offset[ i_symbol_idx ] = i_symbol_offset;
+		i_symbol_offset += 1 << ps_uncompress->pi_offset_extra[ i_symbol_idx ];
+	}
+
+	i_symbol_offset = 0;
+	for( i_symbol_idx = 0; i_symbol_idx < MDEFLATE_MAX_LENGTH_NODES; i_symbol_idx++ )
+	{
+		ps_uncompress->rgui8_length_offset[ i_symbol_idx ] = i_symbol_offset;
+		i_symbol_offset += 1 << rgi_length_extra[ i_symbol_idx ];
+	}
+}
+
+
+void minflate_assign_cw( minflate_uncompress_t *ps_uncompress, int8_t i8_num_nodes, uint8_t *pui8_length_lut, uint8_t *pui8_lut )
+{
+	int8_t i8_cw_length, i8_node;
+	uint8_t ui8_cw, ui8_idx;
+	
+	ui8_cw = 0;
+	for( i8_cw_length = 1; i8_cw_length <= MDEFLATE_MAX_CW_LENGTH; i8_cw_length++ )
+	{
+		for( i8_node = 0; i8_node < i8_num_nodes; i8_node++ )
+		{
+			if( pui8_length_lut[ i8_node ] == i8_cw_length )
+			{
+				uint8_t ui8_dim = 1 << ( 8 - i8_cw_length );
+				for( ui8_idx = 0; ui8_idx < ui8_dim; ui8_idx++ )
+				{
+					pui8_lut[ ui8_cw++ ] = i8_node;
+				}
+			}
+		}
+	}
+}
+
+
+void minflate_read_and_assign_bl_cw( minflate_uncompress_t *ps_uncompress, int8_t i8_num_nodes, uint8_t *pui8_length_lut, uint8_t *pui8_lut )
+{
+	int8_t i8_node;
+
+	for( i8_node = 0; i8_node < i8_num_nodes; i8_node++ )
+	{
+		pui8_length_lut[ i8_node ] = minflate_read_bits( ps_uncompress, 3 );
+#if MDEFLATE_DEBUG_PRINTF > 1
+		printf("node %d, l %d\n", i8_node, pui8_length_lut[ i8_node ] );
+#endif
+	}
+
+	minflate_assign_cw( ps_uncompress, i8_num_nodes, pui8_length_lut, pui8_lut );
+}
+
+#if WITH_WIDE_BIT_READER
+
+MDEFLATE_KERNEL uint8_t minflate_read_symbol( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_node_lut, uint8_t *pui8_node_length_lut )
+{
+	if( ps_uncompress->i_bits < MDEFLATE_MAX_CW_LENGTH )
+	{
+		minflate_refill( ps_uncompress );
+	}
+	return minflate_take_symbol( ps_uncompress, pui8_node_lut, pui8_node_length_lut );
+}
+
+#else
+
+MDEFLATE_KERNEL uint8_t minflate_read_symbol( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_node_lut, uint8_t *pui8_node_length_lut )
+{
+	uint8_t ui8_sym, ui8_len;
+
+	ui8_sym = pui8_node_lut[ ps_uncompress->ui16_cw >> 8 ];
+	ui8_len = pui8_node_length_lut[ ui8_sym ];
+
+	ps_uncompress->ui16_cw <<= ui8_len;
+	ps_uncompress->i8_bits -= ui8_len;
+	if( ps_uncompress->i8_bits < 0 )
+	{
+		ps_uncompress->ui16_cw |= ( *( ps_uncompress->pui8_bitstream++ ) ) << ( -ps_uncompress->i8_bits );
+		ps_uncompress->i8_bits += 8;
+	}
+
+	return ui8_sym;
+}
+
+#endif
+
+void minflate_read_lengths( minflate_uncompress_t *ps_uncompress, int32_t i_num_nodes, uint8_t *pui8_bl_length_lut, uint8_t *pui8_bl_lut, uint8_t *pui8_length_lut )
+{
+	int32_t i_idx;
+
+	for( i_idx = 0; i_idx < i_num_nodes; i_idx++ )
+	{
+		pui8_length_lut[ i_idx ] = minflate_read_symbol( ps_uncompress, pui8_bl_lut, pui8_bl_length_lut );
+	}
+}
+
+
+#if WITH_BYTE_LITERALS
+
+/* codes of up to 8 bits fill runs of the first level, every 8 bit prefix of longer codes links to a second level table
+   indexed by the following MINFLATE_BYTE_SUB_BITS. entries without a code end the block */
+void minflate_build_byte_lut( minflate_uncompress_t *ps_uncompress )
+{
+	int32_t i_cw_length, i_node, i_cw, i_idx, i_run, i_start, i_next_table;
+	uint16_t ui16_entry, *pui16_lut;
+
+	pui16_lut = ps_uncompress->rgui16_byte_lut;
+	for( i_idx = 0; i_idx < MINFLATE_BYTE_LUT_SIZE; i_idx++ )
+	{
+		pui16_lut[ i_idx ] = MDEFLATE_BYTE_END_OF_BLOCK_NODE;
+	}
+
+	i_cw = 0; /* left aligned to MDEFLATE_MAX_BYTE_CW_LENGTH bits */
+	i_next_table = 1 << MDEFLATE_MAX_CW_LENGTH;
+	for( i_cw_length = 1; i_cw_length <= MDEFLATE_MAX_BYTE_CW_LENGTH; i_cw_length++ )
+	{
+		for( i_node = 0; i_node < MDEFLATE_MAX_BYTE_NODES; i_node++ )
+		{
+			if( ps_uncompress->rgui8_byte_length_lut[ i_node ] != i_cw_length )
+			{
+				continue;
+			}
+			i_run = 1 << ( MDEFLATE_MAX_BYTE_CW_LENGTH - i_cw_length );
+			if( i_cw + i_run > ( 1 << MDEFLATE_MAX_BYTE_CW_LENGTH ) )
+			{
+				return; /* broken code lengths */
+			}
+			ui16_entry = ( uint16_t )( ( i_cw_length << MINFLATE_BYTE_LENGTH_SHIFT ) | i_node );
+			i_start = i_cw >> MINFLATE_BYTE_SUB_BITS;
+			if( i_cw_length <= MDEFLATE_MAX_CW_LENGTH )
+			{
+				i_run >>= MINFLATE_BYTE_SUB_BITS;
+			}
+			else
+			{
+				if( !( pui16_lut[ i_start ] & MINFLATE_BYTE_LUT_LINK ) )
+				{
+					if( i_next_table + ( 1 << MINFLATE_BYTE_SUB_BITS ) > MINFLATE_BYTE_LUT_SIZE )
+					{
+						return;
+					}
+					pui16_lut[ i_start ] = ( uint16_t )( MINFLATE_BYTE_LUT_LINK | i_next_table );
+					i_next_table += 1 << MINFLATE_BYTE_SUB_BITS;
+				}
+				i_start = ( pui16_lut[ i_start ] & ~MINFLATE_BYTE_LUT_LINK ) + ( i_cw & ( ( 1 << MINFLATE_BYTE_SUB_BITS ) - 1 ) );
+			}
+			for( i_idx = 0; i_idx < i_run; i_idx++ )
+			{
+				pui16_lut[ i_start + i_idx ] = ui16_entry;
+			}
+			i_cw += 1 << ( MDEFLATE_MAX_BYTE_CW_LENGTH - i_cw_length );
+		}
+	}
+}
+
+
+#if WITH_WIDE_BIT_READER
+
+/* stores a literal and returns 0 or returns the end of block or length symbol, like minflate_take_literal */
+MDEFLATE_KERNEL uint8_t minflate_take_byte_literal( minflate_uncompress_t *ps_uncompress )
+{
+	uint32_t ui_entry, ui_length;
+
+	ui_entry = ps_uncompress->rgui16_byte_lut[ ps_uncompress->ui64_cw >> ( 64 - MDEFLATE_MAX_CW_LENGTH ) ];
+	if( ui_entry & MINFLATE_BYTE_LUT_LINK )
+	{
+		ui_entry = ps_uncompress->rgui16_byte_lut[ ( ui_entry & ~MINFLATE_BYTE_LUT_LINK ) + ( ( ps_uncompress->ui64_cw >> ( 64 - MDEFLATE_MAX_BYTE_CW_LENGTH ) ) & ( ( 1 << MINFLATE_BYTE_SUB_BITS ) - 1 ) ) ];
+	}
+	ui_length = ui_entry >> MINFLATE_BYTE_LENGTH_SHIFT;
+	ps_uncompress->ui64_cw <<= ui_length;
+	ps_uncompress->i_bits -= ui_length;
+
+	ui_entry &= ( 1 << MINFLATE_BYTE_LENGTH_SHIFT ) - 1;
+	if( ui_entry < MDEFLATE_BYTE_END_OF_BLOCK_NODE )
+	{
+		*( ps_uncompress->pui8_out++ ) = ( uint8_t )ui_entry;
+		return 0;
+	}
+	return ( uint8_t )( ui_entry - MDEFLATE_BYTE_NODES_OFFSET );
+}
+
+#else
+
+/* the second level is looked up once the first 8 bits are consumed, at least 8 bits are buffered then */
+MDEFLATE_KERNEL uint8_t minflate_read_byte_literal( minflate_uncompress_t *ps_uncompress )
+{
+	uint32_t ui_entry;
+
+	ui_entry = ps_uncompress->rgui16_byte_lut[ ps_uncompress->ui16_cw >> 8 ];
+	if( ui_entry & MINFLATE_BYTE_LUT_LINK )
+	{
+		minflate_read_bits( ps_uncompress, MDEFLATE_MAX_CW_LENGTH );
+		ui_entry = ps_uncompress->rgui16_byte_lut[ ( ui_entry & ~MINFLATE_BYTE_LUT_LINK ) + ( ps_uncompress->ui16_cw >> ( 16 - MINFLATE_BYTE_SUB_BITS ) ) ];
+		minflate_read_bits( ps_uncompress, ( ui_entry >> MINFLATE_BYTE_LENGTH_SHIFT ) - MDEFLATE_MAX_CW_LENGTH );
+	}
+	else
+	{
+		minflate_read_bits( ps_uncompress, ui_entry >> MINFLATE_BYTE_LENGTH_SHIFT );
+	}
+
+	ui_entry &= ( 1 << MINFLATE_BYTE_LENGTH_SHIFT ) - 1;
+	if( ui_entry < MDEFLATE_BYTE_END_OF_BLOCK_NODE )
+	{
+		*( ps_uncompress->pui8_out++ ) = ( uint8_t )ui_entry;
+		return 0;
+	}
+	return ( uint8_t )( ui_entry - MDEFLATE_BYTE_NODES_OFFSET );
+}
+
+#endif
+
+#endif
+
+
+#if MINFLATE_PAIR_LUT
+
+void minflate_first_cw( uint8_t *pui8_lut, uint8_t *pui8_first_cw )
+{
+	int32_t i_idx;
+
+	for( i_idx = ( 1 << MDEFLATE_MAX_CW_LENGTH ) - 1; i_idx >= 0; i_idx-- )
+	{
+		if( pui8_lut[ i_idx ] <= MDEFLATE_MAX_LITERAL_NODE )
+		{
+			pui8_first_cw[ pui8_lut[ i_idx ] ] = i_idx;
+		}
+	}
+}
+
+
+void minflate_build_pair_lut( minflate_uncompress_t *ps_uncompress )
+{
+	int32_t i_low, i_high, i_low_length, i_high_length, i_idx, i_start, i_run;
+	uint8_t rgui8_low_cw[ MDEFLATE_MAX_LITERAL_NODES ], rgui8_high_cw[ MDEFLATE_MAX_LITERAL_NODES ];
+	uint8_t *pui8_high_length_lut;
+	uint16_t ui16_entry;
+
+	memset( ps_uncompress->rgui16_pair_lut, 0, sizeof( ps_uncompress->rgui16_pair_lut ) );
+
+	minflate_first_cw( ps_uncompress->rgui8_symbol_lut, rgui8_low_cw );
+	minflate_first_cw( ps_uncompress->pui8_literal_lut, rgui8_high_cw );
+	pui8_high_length_lut = ps_uncompress->pui8_literal_length_lut;
+
+	/* every pair of codes that fits fills a run of entries, the rest stays 0 and takes the two lookup path */
+	for( i_low = 0; i_low < MDEFLATE_MAX_LITERAL_NODES; i_low++ )
+	{
+		i_low_length = ps_uncompress->rgui8_symbol_length_lut[ i_low ];
+		if( i_low_length == 0 )
+		{
+			continue;
+		}
+		for( i_high = 0; i_high < MDEFLATE_MAX_LITERAL_NODES; i_high++ )
+		{
+			i_high_length = pui8_high_length_lut[ i_high ];
+			if( i_high_length == 0 || i_low_length + i_high_length > MINFLATE_PAIR_LUT_BITS )
+			{
+				continue;
+			}
+			i_start = ( rgui8_low_cw[ i_low ] >> ( MDEFLATE_MAX_CW_LENGTH - i_low_length ) ) << i_high_length;
+			i_start |= rgui8_high_cw[ i_high ] >> ( MDEFLATE_MAX_CW_LENGTH - i_high_length );
+			i_run = 1 << ( MINFLATE_PAIR_LUT_BITS - i_low_length - i_high_length );
+			i_start *= i_run;
+			ui16_entry = ( uint16_t )( ( ( i_low_length + i_high_length ) << 8 ) | ( i_high << 4 ) | i_low );
+			for( i_idx = 0; i_idx < i_run; i_idx++ )
+			{
+				ps_uncompress->rgui16_pair_lut[ i_start + i_idx ] = ui16_entry;
+			}
+		}
+	}
+}
+
+#endif
+
+
+#if MDEFLATE_DISPATCH
+
+/* pshufb masks that repeat the first i_offset bytes of a 16 byte load, rows 0 and 1 are unused */
+const uint8_t rgui8_pattern_shuffle[ 16 ][ 16 ] = {
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 },
+	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0 },
+	{ 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0 }
+};
+
+
+/* copies a match with an offset of 2 to 15 with pshufb. the pattern spread over 16 bytes is stored every largest
+   multiple of i_offset up to 16 bytes, the caller ensures MINFLATE_OUT_SLACK bytes behind the match */
+MDEFLATE_TARGET( "ssse3" ) static inline uint8_t *minflate_copy_pattern_ssse3( uint8_t *pui8_out, int32_t i_offset, uint8_t *pui8_copy_end )
+{
+	__m128i s_pattern;
+	int32_t i_step;
+
+	s_pattern = _mm_shuffle_epi8( _mm_loadu_si128( ( const __m128i * )( pui8_out - i_offset ) ), _mm_loadu_si128( ( const __m128i * )&rgui8_pattern_shuffle[ i_offset ][ 0 ] ) );
+	i_step = 16 - 16 % i_offset;
+	do {
+		_mm_storeu_si128( ( __m128i * )pui8_out, s_pattern );
+		pui8_out += i_step;
+	} while( pui8_out < pui8_copy_end );
+	return pui8_copy_end;
+}
+
+#endif
+
+
+/* copies i_length bytes from i_offset back, in 16 or 8 byte chunks where the offset allows or with pshufb for short
+   offsets if i_shuffle is set. chunks may write up to MINFLATE_OUT_SLACK - 1 bytes past the match which are
+   overwritten by the following data, near pui8_out_end bytes are copied one by one */
+MDEFLATE_KERNEL uint8_t *minflate_copy_match( uint8_t *pui8_out, int32_t i_offset, int32_t i_length, uint8_t *pui8_out_end, const int32_t i_shuffle )
+{
+	uint8_t *pui8_bcopy, *pui8_copy_end;
+	int32_t i_distance, i_prefix;
+
+	pui8_bcopy = pui8_out - i_offset;
+	pui8_copy_end = pui8_out + i_length;
+
+	if( i_offset == 1 )
+	{
+		memset( pui8_out, *pui8_bcopy, i_length );
+		return pui8_copy_end;
+	}
+	if( pui8_copy_end + MINFLATE_OUT_SLACK > pui8_out_end )
+	{
+		while( pui8_out < pui8_copy_end )
+		{
+			*( pui8_out++ ) = *( pui8_bcopy++ );
+		}
+		return pui8_copy_end;
+	}
+
+	if( i_offset >= 16 )
+	{
+		do {
+			memcpy( pui8_out, pui8_bcopy, 16 );
+			pui8_out += 16;
+			pui8_bcopy += 16;
+		} while( pui8_out < pui8_copy_end );
+		return pui8_copy_end;
+	}
+#if MDEFLATE_DISPATCH
+	if( i_shuffle )
+	{
+		return minflate_copy_pattern_ssse3( pui8_out, i_offset, pui8_copy_end );
+	}
+#else
+	( void )i_shuffle;
+#endif
+
+	/* the match repeats every i_offset bytes and so every multiple of it. after i_distance - i_offset bytes are in
+	   place 8 byte chunks can be copied from the first multiple that is at least 8 bytes back */
+	i_distance = i_offset;
+	while( i_distance < 8 )
+	{
+		i_distance += i_offset;
+	}
+	i_prefix = i_distance - i_offset < i_length ? i_distance - i_offset : i_length;
+	while( i_prefix-- > 0 )
+	{
+		*( pui8_out++ ) = *( pui8_bcopy++ );
+	}
+	pui8_bcopy = pui8_out - i_distance;
+	while( pui8_out < pui8_copy_end )
+	{
+		memcpy( pui8_out, pui8_bcopy, 8 );
+		pui8_out += 8;
+		pui8_bcopy += 8;
+	}
+	return pui8_copy_end;
+}
+
+
+/* copies a match which starts in the preset dictionary in front of the block output at pui8_out_start and may run
+   on into the output. offsets before the dictionary come from broken input and produce zeros */
+uint8_t *minflate_copy_dict_match( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_out_start, int32_t i_offset, int32_t i_length )
+{
+	uint8_t *pui8_out;
+	int32_t i_dict_back, i_copy;
+
+	pui8_out = ps_uncompress->pui8_out;
+	if( i_length > ps_uncompress->pui8_out_end - pui8_out )
+	{
+		i_length = ( int32_t )( ps_uncompress->pui8_out_end - pui8_out );
+	}
+	i_dict_back = i_offset - ( int32_t )( pui8_out - pui8_out_start );
+	i_copy = i_length < i_dict_back ? i_length : i_dict_back;
+	if( i_dict_back > ps_uncompress->i_dict_length )
+	{
+		memset( pui8_out, 0, i_copy );
+	}
+	else
+	{
+		memcpy( pui8_out, ps_uncompress->pui8_dict + ps_uncompress->i_dict_length - i_dict_back, i_copy );
+	}
+	pui8_out += i_copy;
+	if( i_length > i_copy )
+	{
+		pui8_out = minflate_copy_match( pui8_out, i_offset, i_length - i_copy, ps_uncompress->pui8_out_end, 0 );
+	}
+	return pui8_out;
+}
+
+
+#if WITH_WIDE_BIT_READER
+
+/* stores a literal and returns 0 or returns the end of block or length symbol */
+MDEFLATE_KERNEL uint8_t minflate_take_literal( minflate_uncompress_t *ps_uncompress )
+{
+	uint8_t ui8_sym;
+#if MINFLATE_PAIR_LUT
+	uint16_t ui16_pair;
+
+	ui16_pair = ps_uncompress->rgui16_pair_lut[ ps_uncompress->ui64_cw >> ( 64 - MINFLATE_PAIR_LUT_BITS ) ];
+	if( ui16_pair >> 8 )
+	{
+		ps_uncompress->ui64_cw <<= ui16_pair >> 8;
+		ps_uncompress->i_bits -= ui16_pair >> 8;
+		*( ps_uncompress->pui8_out++ ) = ( uint8_t )ui16_pair;
+		return 0;
+	}
+#endif
+
+	ui8_sym = minflate_take_symbol( ps_uncompress, ps_uncompress->rgui8_symbol_lut, ps_uncompress->rgui8_symbol_length_lut );
+	if( ui8_sym <= MDEFLATE_MAX_LITERAL_NODE )
+	{
+		ui8_sym |= ( minflate_take_symbol( ps_uncompress, ps_uncompress->pui8_literal_lut, ps_uncompress->pui8_literal_length_lut ) ) << 4;
+		*( ps_uncompress->pui8_out++ ) = ui8_sym;
+		return 0;
+	}
+	return ui8_sym;
+}
+
+
+/* takes a single literal after a refill, like minflate_take_literal */
+MDEFLATE_KERNEL uint8_t minflate_next_literal( minflate_uncompress_t *ps_uncompress )
+{
+	minflate_refill( ps_uncompress );
+#if WITH_BYTE_LITERALS
+	if( ps_uncompress->i_byte_tree )
+	{
+		return minflate_take_byte_literal( ps_uncompress );
+	}
+#endif
+	return minflate_take_literal( ps_uncompress );
+}
+
+#else
+
+/* stores a literal and returns 0 or returns the end of block or length symbol */
+MDEFLATE_KERNEL uint8_t minflate_next_literal( minflate_uncompress_t *ps_uncompress )
+{
+	uint8_t ui8_sym;
+
+#if WITH_BYTE_LITERALS
+	if( ps_uncompress->i_byte_tree )
+	{
+		return minflate_read_byte_literal( ps_uncompress );
+	}
+#endif
+	ui8_sym = minflate_read_symbol( ps_uncompress, ps_uncompress->rgui8_symbol_lut, ps_uncompress->rgui8_symbol_length_lut );
+	if( ui8_sym <= MDEFLATE_MAX_LITERAL_NODE )
+	{
+		ui8_sym |= ( minflate_read_symbol( ps_uncompress, ps_uncompress->pui8_literal_lut, ps_uncompress->pui8_literal_length_lut ) ) << 4;
+		*( ps_uncompress->pui8_out++ ) = ui8_sym;
+		return 0;
+	}
+	return ui8_sym;
+}
+
+#endif
+
+
+/* decodes the symbols of a block up to its end of block into ps_uncompress->pui8_out, returns the number of matches
+   and their bytes in *pi_match_bytes or -1 if the block runs past pui8_out_end. nothing is written at or past it.
+   i_shuffle is a constant of the variant and selects the pshufb match copy */
+MDEFLATE_KERNEL int32_t minflate_decode_symbols_kernel( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_out_data, int32_t *pi_match_bytes, const int32_t i_shuffle )
+{
+	uint8_t ui8_sym;
+	int32_t i_length_bcopy, i_matches;
+
+	i_length_bcopy = i_matches = 0;
+	ui8_sym = 0;
+
+#if WITH_WIDE_BIT_READER
+	/* one refill covers a literal followed by another literal or a match, at most 2 * 8 + 8 + 7 + 8 + 16 bits
+	   of the 56 buffered or with the byte tree 12 + 12 + 7 + 8 + 16 */
+	while( ui8_sym != MDEFLATE_END_OF_BLOCK_NODE && ps_uncompress->pui8_out_end - ps_uncompress->pui8_out >= 2 )
+	{
+		minflate_refill( ps_uncompress );
+#if WITH_BYTE_LITERALS
+		if( ps_uncompress->i_byte_tree )
+		{
+			ui8_sym = minflate_take_byte_literal( ps_uncompress );
+			if( ui8_sym == 0 )
+			{
+				ui8_sym = minflate_take_byte_literal( ps_uncompress );
+			}
+		}
+		else
+#endif
+		{
+			ui8_sym = minflate_take_literal( ps_uncompress );
+			if( ui8_sym == 0 )
+			{
+				ui8_sym = minflate_take_literal( ps_uncompress );
+			}
+		}
+		if( ui8_sym >= MDEFLATE_LENGTH_NODES_OFFSET )
+		{
+			uint8_t ui8_length_sym, ui8_offset_sym;
+			int32_t i_length, i_offset;
+
+			ui8_length_sym = ui8_sym - MDEFLATE_LENGTH_NODES_OFFSET;
+			i_length = ps_uncompress->rgui8_length_offset[ ui8_length_sym ] + MDEFLATE_MATCH_LENGTH_OFFSET;
+			i_length += minflate_take_bits( ps_uncompress, rgi_length_extra[ ui8_length_sym ] );
+			ui8_offset_sym = minflate_take_symbol( ps_uncompress, ps_uncompress->rgui8_offset_lut, ps_uncompress->rgui8_offset_length_lut );
+			i_offset = ps_uncompress->rgui_offset_offset[ ui8_offset_sym ] + 1;
+			i_offset += minflate_take_bits( ps_uncompress, ps_uncompress->pi_offset_extra[ ui8_offset_sym ] );
+
+			i_length_bcopy += i_length;
+			i_matches++;
+
+			if( i_length > ps_uncompress->pui8_out_end - ps_uncompress->pui8_out )
+			{
+				return -1;
+			}
+			if( ps_uncompress->pui8_dict != NULL && i_offset > ps_uncompress->pui8_out - pui8_out_data )
+			{
+				ps_uncompress->pui8_out = minflate_copy_dict_match( ps_uncompress, pui8_out_data, i_offset, i_length );
+			}
+			else
+			{
+				ps_uncompress->pui8_out = minflate_copy_match( ps_uncompress->pui8_out, i_offset, i_length, ps_uncompress->pui8_out_end, i_shuffle );
+			}
+		}
+	}
+#else
+	while( ui8_sym != MDEFLATE_END_OF_BLOCK_NODE && ps_uncompress->pui8_out < ps_uncompress->pui8_out_end )
+	{
+		ui8_sym = minflate_next_literal( ps_uncompress );
+		if( ui8_sym >= MDEFLATE_LENGTH_NODES_OFFSET )
+		{
+			uint8_t ui8_length_sym, ui8_offset_sym, ui8_length, ui8_length_extra;
+			int32_t i_offset, i_offset_extra;
+
+			ui8_length_sym = ui8_sym - MDEFLATE_LENGTH_NODES_OFFSET;
+			ui8_length = ps_uncompress->rgui8_length_offset[ ui8_length_sym ];
+			ui8_length_extra = minflate_read_bits( ps_uncompress, rgi_length_extra[ ui8_length_sym ] );
+			ui8_length += ui8_length_extra;
+			ui8_length += MDEFLATE_MATCH_LENGTH_OFFSET;
+			ui8_offset_sym = minflate_read_symbol( ps_uncompress, ps_uncompress->rgui8_offset_lut, ps_uncompress->rgui8_offset_length_lut );
+			i_offset = ps_uncompress->rgui_offset_offset[ ui8_offset_sym ];
+			i_offset_extra = minflate_read_bits( ps_uncompress, ps_uncompress->pi_offset_extra[ ui8_offset_sym ] );
+			i_offset += i_offset_extra;
+			i_offset += 1;
+
+#if MDEFLATE_DEBUG_PRINTF > 1
+			printf("bcopy %d %d (%d %d )\n", ui8_length, i_offset, ui8_length_extra, i_offset_extra );
+#endif
+			i_length_bcopy += ui8_length;
+			i_matches++;
+
+			if( ui8_length > ps_uncompress->pui8_out_end - ps_uncompress->pui8_out )
+			{
+				return -1;
+			}
+			if( ps_uncompress->pui8_dict != NULL && i_offset > ps_uncompress->pui8_out - pui8_out_data )
+			{
+				ps_uncompress->pui8_out = minflate_copy_dict_match( ps_uncompress, pui8_out_data, i_offset, ui8_length );
+			}
+			else
+			{
+				ps_uncompress->pui8_out = minflate_copy_match( ps_uncompress->pui8_out, i_offset, ui8_length, ps_uncompress->pui8_out_end, i_shuffle );
+			}
+		}
+	}
+#endif
+
+	/* the loops stop when a pair of literals might not fit anymore. at most a literal and the end of block can
+	   follow, they are decoded into rgui8_tail and only copied if they fit */
+	if( ui8_sym != MDEFLATE_END_OF_BLOCK_NODE )
+	{
+		uint8_t rgui8_tail[ 2 ], *pui8_out;
+		int32_t i_tail;
+
+		pui8_out = ps_uncompress->pui8_out;
+		ps_uncompress->pui8_out = &rgui8_tail[ 0 ];
+		do {
+			ui8_sym = minflate_next_literal( ps_uncompress );
+		} while( ui8_sym == 0 && ps_uncompress->pui8_out < &rgui8_tail[ 2 ] );
+		i_tail = ( int32_t )( ps_uncompress->pui8_out - &rgui8_tail[ 0 ] );
+		ps_uncompress->pui8_out = pui8_out;
+		if( ui8_sym != MDEFLATE_END_OF_BLOCK_NODE || i_tail > ps_uncompress->pui8_out_end - pui8_out )
+		{
+			return -1;
+		}
+		memcpy( pui8_out, &rgui8_tail[ 0 ], i_tail );
+		ps_uncompress->pui8_out += i_tail;
+	}
+
+	*pi_match_bytes = i_length_bcopy;
+	return i_matches;
+}
+
+
+int32_t minflate_decode_symbols( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_out_data, int32_t *pi_match_bytes )
+{
+	return minflate_decode_symbols_kernel( ps_uncompress, pui8_out_data, pi_match_bytes, 0 );
+}
+
+#if MDEFLATE_DISPATCH
+
+/* pshufb for the match copies with offsets of 2 to 15 */
+MDEFLATE_TARGET( "ssse3" ) int32_t minflate_decode_symbols_ssse3( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_out_data, int32_t *pi_match_bytes )
+{
+	return minflate_decode_symbols_kernel( ps_uncompress, pui8_out_data, pi_match_bytes, 1 );
+}
+
+
+/* shrx, shlx and bzhi for the variable shifts of the bit reader on top of the pshufb match copy */
+MDEFLATE_TARGET( "bmi2,ssse3" ) int32_t minflate_decode_symbols_bmi2( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_out_data, int32_t *pi_match_bytes )
+{
+	return minflate_decode_symbols_kernel( ps_uncompress, pui8_out_data, pi_match_bytes, 1 );
+}
+
+#endif
+
+
+/* binds the kernels for the MDEFLATE_CPU_* in i_features, minflate_init passes mdeflate_cpu_features( ) */
+void minflate_bind_kernels( minflate_uncompress_t *ps_uncompress, int32_t i_features )
+{
+	ps_uncompress->pf_decode_symbols = minflate_decode_symbols;
+#if MDEFLATE_DISPATCH
+	if( i_features & MDEFLATE_CPU_SSSE3 )
+	{
+		ps_uncompress->pf_decode_symbols = minflate_decode_symbols_ssse3;
+	}
+	if( ( i_features & ( MDEFLATE_CPU_SSSE3 | MDEFLATE_CPU_BMI2 ) ) == ( MDEFLATE_CPU_SSSE3 | MDEFLATE_CPU_BMI2 ) )
+	{
+		ps_uncompress->pf_decode_symbols = minflate_decode_symbols_bmi2;
+	}
+#else
+	( void )i_features;
+#endif
+}
+
+
+void minflate_init( minflate_uncompress_t *ps_uncompress, const mdeflate_format_t *ps_format )
+{
+	memset( ps_uncompress, 0, sizeof( minflate_uncompress_t ) );
+	ps_uncompress->s_format = *ps_format;
+	ps_uncompress->pi_offset_extra = ps_uncompress->s_format.rgi_offset_extra;
+	minflate_init_length_and_offset_table( ps_uncompress );
+	minflate_bind_kernels( ps_uncompress, mdeflate_cpu_features( ) );
+}
+
+
+minflate_uncompress_t *minflate_create( const mdeflate_format_t *ps_format )
+{
+	minflate_uncompress_t *ps_uncompress;
+
+	ps_uncompress = ( minflate_uncompress_t * )malloc( sizeof( minflate_uncompress_t ) );
+	if( ps_uncompress == NULL )
+	{
+		return NULL;
+	}
+	minflate_init( ps_uncompress, ps_format );
+	return ps_uncompress;
+}
+
+
+/* lets every following block reference the last i_dict_length bytes of pui8_dict as if they preceeded its output.
+   the dictionary is not copied and has to stay valid, NULL removes it */
+void minflate_set_dict( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_dict, int32_t i_dict_length )
+{
+	if( i_dict_length > ps_uncompress->s_format.i_window_size )
+	{
+		pui8_dict += i_dict_length - ps_uncompress->s_format.i_window_size;
+		i_dict_length = ps_uncompress->s_format.i_window_size;
+	}
+	ps_uncompress->pui8_dict = pui8_dict;
+	ps_uncompress->i_dict_length = i_dict_length;
+}
+
+
+/* the following blocks add to *ps_stats, NULL stops collecting */
+void minflate_set_stats( minflate_uncompress_t *ps_uncompress, mdeflate_stats_t *ps_stats )
+{
+	ps_uncompress->ps_stats = ps_stats;
+}
+
+
+/* forgets the tables of the last block, needed where the compressor reset its context */
+void minflate_reset( minflate_uncompress_t *ps_uncompress )
+{
+	ps_uncompress->i_have_tables = 0;
+}
+
+
+void minflate_destroy( minflate_uncompress_t *ps_uncompress )
+{
+	free( ps_uncompress );
+}
+
+
+void minflate_start_bits( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_in_data, int32_t i_in_data_length )
+{
+#if WITH_WIDE_BIT_READER
+	ps_uncompress->i_bits = 0;
+	ps_uncompress->ui64_cw = 0;
+	ps_uncompress->pui8_bitstream = pui8_in_data;
+	ps_uncompress->pui8_bitstream_end = pui8_in_data + i_in_data_length;
+	minflate_refill( ps_uncompress );
+#else
+	( void )i_in_data_length;
+	ps_uncompress->i8_bits = 8;
+	ps_uncompress->ui16_cw = ( pui8_in_data[ 0 ] << 8 ) | pui8_in_data[ 1 ];
+	ps_uncompress->pui8_bitstream = pui8_in_data + 2;
+#endif
+}
+
+
+/* bits read since pui8_in_data */
+int32_t minflate_bits_taken( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_in_data )
+{
+#if WITH_WIDE_BIT_READER
+	return ( int32_t )( ps_uncompress->pui8_bitstream - pui8_in_data ) * 8 - ps_uncompress->i_bits;
+#else
+	return ( int32_t )( ps_uncompress->pui8_bitstream - pui8_in_data ) * 8 - 8 - ps_uncompress->i8_bits;
+#endif
+}
+
+
+/* adds a decoded block, the histograms stay with the compressor */
+void minflate_stats_add_block( mdeflate_stats_t *ps_stats, uint32_t ui_block_type, int32_t i_in_data_length, int32_t i_out_length, int32_t i_matches, int32_t i_match_bytes, int32_t i_header_bits )
+{
+	mdeflate_stats_add_block( ps_stats, ui_block_type < MDEFLATE_BLOCK_TYPE_SEPARATE ? ( int32_t )ui_block_type : MDEFLATE_BLOCK_TYPE_SEPARATE, i_out_length, i_in_data_length, i_header_bits );
+	ps_stats->i64_literals += i_out_length - i_match_bytes;
+	ps_stats->i64_matches += i_matches;
+	ps_stats->i64_match_bytes += i_match_bytes;
+}
+
+
+/* decodes one block with the tables kept in ps_uncompress, blocks reusing the tables of the previous one
+   have to be decoded in order with the same context. returns -1 if such a block comes without tables or the block
+   does not fit up to pui8_out_end, nothing is written at or past it */
+int32_t minflate_dec_block_ctx( minflate_uncompress_t *ps_uncompress, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, uint8_t *pui8_out_end )
+{
+	int32_t i_length_literal, i_length_bcopy, i_matches, i_header_bits;
+	uint32_t ui_block_type;
+
+	ui_block_type = i_in_data_length >= MDEFLATE_STORED_BLOCK_HEADER ? ( uint32_t )mdeflate_read_be( pui8_in_data, MDEFLATE_STORED_BLOCK_HEADER ) : ~0U;
+	if( ui_block_type == MDEFLATE_BLOCK_TYPE_STORED )
+	{
+		MDEFLATE_STAGE_START( ps_uncompress, MINFLATE_STAGE_DECODE );
+		i_length_literal = i_in_data_length - MDEFLATE_STORED_BLOCK_HEADER;
+		if( i_length_literal > pui8_out_end - pui8_out_data )
+		{
+			MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_DECODE );
+			return -1;
+		}
+		memcpy( pui8_out_data, pui8_in_data + MDEFLATE_STORED_BLOCK_HEADER, i_length_literal );
+		MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_DECODE );
+		if( ps_uncompress->ps_stats != NULL )
+		{
+			minflate_stats_add_block( ps_uncompress->ps_stats, ui_block_type, i_in_data_length, i_length_literal, 0, 0, MDEFLATE_STORED_BLOCK_HEADER * 8 );
+		}
+		return i_length_literal;
+	}
+
+	MDEFLATE_STAGE_START( ps_uncompress, MINFLATE_STAGE_TABLES );
+
+	ps_uncompress->ui8_out_slot = 0;
+	ps_uncompress->pui8_out = pui8_out_data;
+	ps_uncompress->pui8_out_end = pui8_out_end;
+
+	if( ui_block_type == MDEFLATE_BLOCK_TYPE_REUSE )
+	{
+		if( !ps_uncompress->i_have_tables )
+		{
+			MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_TABLES );
+			return -1;
+		}
+		minflate_start_bits( ps_uncompress, pui8_in_data + MDEFLATE_BLOCK_TYPE_BITS / 8, i_in_data_length - MDEFLATE_BLOCK_TYPE_BITS / 8 );
+	}
+	else if( ui_block_type == MDEFLATE_BLOCK_TYPE_BYTE )
+	{
+#if WITH_BYTE_LITERALS
+		minflate_start_bits( ps_uncompress, pui8_in_data + MDEFLATE_BLOCK_TYPE_BITS / 8, i_in_data_length - MDEFLATE_BLOCK_TYPE_BITS / 8 );
+		minflate_read_and_assign_bl_cw( ps_uncompress, MDEFLATE_MAX_BYTE_BL_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ] );
+		minflate_read_lengths( ps_uncompress, MDEFLATE_MAX_BYTE_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ], &ps_uncompress->rgui8_byte_length_lut[ 0 ] );
+		minflate_read_lengths( ps_uncompress, MDEFLATE_MAX_OFFSET_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ], &ps_uncompress->rgui8_offset_length_lut[ 0 ] );
+		minflate_assign_cw( ps_uncompress, MDEFLATE_MAX_OFFSET_NODES, &ps_uncompress->rgui8_offset_length_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ] );
+		minflate_build_byte_lut( ps_uncompress );
+		ps_uncompress->i_byte_tree = 1;
+		ps_uncompress->i_have_tables = 1;
+#else
+		MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_TABLES );
+		return -1;
+#endif
+	}
+	else
+	{
+		if( ui_block_type == MDEFLATE_BLOCK_TYPE_SHARED )
+		{
+			minflate_start_bits( ps_uncompress, pui8_in_data + MDEFLATE_BLOCK_TYPE_BITS / 8, i_in_data_length - MDEFLATE_BLOCK_TYPE_BITS / 8 );
+			ps_uncompress->pui8_literal_lut = ps_uncompress->rgui8_symbol_lut;
+			ps_uncompress->pui8_literal_length_lut = ps_uncompress->rgui8_symbol_length_lut;
+		}
+		else
+		{
+			minflate_start_bits( ps_uncompress, pui8_in_data, i_in_data_length );
+			ps_uncompress->pui8_literal_lut = ps_uncompress->rgui8_literal_lut;
+			ps_uncompress->pui8_literal_length_lut = ps_uncompress->rgui8_literal_length_lut;
+		}
+
+		minflate_read_and_assign_bl_cw( ps_uncompress, MDEFLATE_MAX_BL_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ] );
+
+		minflate_read_lengths( ps_uncompress, MDEFLATE_MAX_SYMBOL_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ], &ps_uncompress->rgui8_symbol_length_lut[ 0 ] );
+		if( ui_block_type != MDEFLATE_BLOCK_TYPE_SHARED )
+		{
+			minflate_read_lengths( ps_uncompress, MDEFLATE_MAX_LITERAL_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ], &ps_uncompress->rgui8_literal_length_lut[ 0 ] );
+		}
+		minflate_read_lengths( ps_uncompress, MDEFLATE_MAX_OFFSET_NODES, &ps_uncompress->rgui8_symbol_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ], &ps_uncompress->rgui8_offset_length_lut[ 0 ] );
+
+		minflate_assign_cw( ps_uncompress, MDEFLATE_MAX_SYMBOL_NODES, &ps_uncompress->rgui8_symbol_length_lut[ 0 ], &ps_uncompress->rgui8_symbol_lut[ 0 ] );
+		if( ui_block_type != MDEFLATE_BLOCK_TYPE_SHARED )
+		{
+			minflate_assign_cw( ps_uncompress, MDEFLATE_MAX_LITERAL_NODES, &ps_uncompress->rgui8_literal_length_lut[ 0 ], &ps_uncompress->rgui8_literal_lut[ 0 ] );
+		}
+		minflate_assign_cw( ps_uncompress, MDEFLATE_MAX_OFFSET_NODES, &ps_uncompress->rgui8_offset_length_lut[ 0 ], &ps_uncompress->rgui8_offset_lut[ 0 ] );
+#if MINFLATE_PAIR_LUT
+		minflate_build_pair_lut( ps_uncompress );
+#endif
+		ps_uncompress->i_byte_tree = 0;
+		ps_uncompress->i_have_tables = 1;
+	}
+	i_header_bits = ps_uncompress->ps_stats != NULL ? minflate_bits_taken( ps_uncompress, pui8_in_data ) : 0;
+	MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_TABLES );
+
+	MDEFLATE_STAGE_START( ps_uncompress, MINFLATE_STAGE_DECODE );
+	i_matches = ps_uncompress->pf_decode_symbols( ps_uncompress, pui8_out_data, &i_length_bcopy );
+	MDEFLATE_STAGE_END( ps_uncompress, MINFLATE_STAGE_DECODE );
+	if( i_matches < 0 )
+	{
+		return -1;
+	}
+
+	if( ps_uncompress->ps_stats != NULL )
+	{
+		minflate_stats_add_block( ps_uncompress->ps_stats, ui_block_type, i_in_data_length, ( int32_t )( ps_uncompress->pui8_out - pui8_out_data ), i_matches, i_length_bcopy, i_header_bits );
+	}
+
+	return ( int32_t ) ( ps_uncompress->pui8_out - pui8_out_data );
+}
+
+
+int32_t minflate_dec_block_format( const mdeflate_format_t *ps_format, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, uint8_t *pui8_out_end )
+{
+	minflate_uncompress_t s_uncompress;
+
+	minflate_init( &s_uncompress, ps_format );
+	return minflate_dec_block_ctx( &s_uncompress, pui8_in_data, i_in_data_length, pui8_out_data, pui8_out_end );
+}
+
+
+int32_t minflate_dec_block_dict( const mdeflate_format_t *ps_format, uint8_t *pui8_dict, int32_t i_dict_length, uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, uint8_t *pui8_out_end )
+{
+	minflate_uncompress_t s_uncompress;
+
+	minflate_init( &s_uncompress, ps_format );
+	minflate_set_dict( &s_uncompress, pui8_dict, i_dict_length );
+	return minflate_dec_block_ctx( &s_uncompress, pui8_in_data, i_in_data_length, pui8_out_data, pui8_out_end );
+}
+
+
+int32_t minflate_dec_block_end( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data, uint8_t *pui8_out_end )
+{
+	mdeflate_format_t s_format;
+
+	mdeflate_init_format( &s_format, 0, 0 );
+	return minflate_dec_block_format( &s_format, pui8_in_data, i_in_data_length, pui8_out_data, pui8_out_end );
+}
+
+
+int32_t minflate_dec_block( uint8_t *pui8_in_data, int32_t i_in_data_length, uint8_t *pui8_out_data )
+{
+	return minflate_dec_block_end( pui8_in_data, i_in_data_length, pui8_out_data, pui8_out_data + MDEFLATE_BLOCK_SIZE / 2 );
+}
+
+
+/* returns the size of the stream header, 0 for the legacy format without one or -1 if it is broken */
+int32_t minflate_read_header( mdeflate_format_t *ps_format, uint8_t *pui8_in, int64_t i64_in_length )
+{
+	if( i64_in_length < 2 || pui8_in[ 0 ] != 'M' || pui8_in[ 1 ] != 'D' )
+	{
+		mdeflate_init_format( ps_format, 0, 0 );
+		return 0;
+	}
+	if( i64_in_length < MDEFLATE_HEADER_SIZE ||
+		pui8_in[ 2 ] < MDEFLATE_MIN_LOG || pui8_in[ 2 ] > MDEFLATE_MAX_LOG || pui8_in[ 3 ] < MDEFLATE_MIN_LOG || pui8_in[ 3 ] > MDEFLATE_MAX_LOG )
+	{
+		return -1;
+	}
+	mdeflate_init_format( ps_format, pui8_in[ 2 ], pui8_in[ 3 ] );
+	return MDEFLATE_HEADER_SIZE;
+}
+
+
+/* ------------------------ BLOCKS ------------------------ */
+
+
+typedef struct {
+	const mdeflate_params_t *ps_params;
+	mdeflate_format_t s_format;
+	uint8_t *pui8_in_data;
+	int64_t i64_in_data_length;
+	int32_t i_cb_back;
+	uint8_t *pui8_out_data;
+
+	int32_t i_job_blocks;
+	int32_t i_num_jobs;
+	int32_t i_next_job;
+	int64_t *pi64_job_size;
+	int32_t i_error;
+#if WITH_THREADS
+	pthread_mutex_t s_mutex;
+#endif
+} mdeflate_jobs_t;
+
+
+int64_t mdeflate_enc_job( mdeflate_compress_t *ps_compress, mdeflate_jobs_t *ps_jobs, int32_t i_job )
+{
+	int64_t i64_pos, i64_end, i64_cb_back, i64_out_size;
+	int32_t i_length, i_edata_size, i_length_bytes;
+	uint8_t *pui8_out;
+	mdeflate_format_t *ps_format = &ps_jobs->s_format;
+
+	i_length_bytes = ps_format->i_length_bytes;
+	i64_pos = ( int64_t )i_job * ps_jobs->i_job_blocks * ps_format->i_block_size;
+	i64_end = i64_pos + ( int64_t )ps_jobs->i_job_blocks * ps_format->i_block_size;
+	if( i64_end > ps_jobs->i64_in_data_length )
+	{
+		i64_end = ps_jobs->i64_in_data_length;
+	}
+	pui8_out = ps_jobs->pui8_out_data + ( int64_t )i_job * ps_jobs->i_job_blocks * ( ps_format->i_enc_block_bound + i_length_bytes );
+	i64_out_size = 0;
+	i64_cb_back = ps_jobs->ps_params->i_reset_blocks > 0 ? 0 : i64_pos + ps_jobs->i_cb_back;
+	mdeflate_reset( ps_compress ); /* jobs are compressed in any order, the first block brings its own tables */
+
+	while( i64_pos < i64_end )
+	{
+		i_length = ps_format->i_block_size;
+		if( i_length > i64_end - i64_pos )
+		{
+			i_length = ( int32_t )( i64_end - i64_pos );
+		}
+		if( i64_cb_back > ps_format->i_window_size )
+		{
+			i64_cb_back = ps_format->i_window_size;
+		}
+
+		i_edata_size = mdeflate_enc_blocks_ctx( ps_compress, ps_jobs->pui8_in_data + i64_pos, i_length, &pui8_out[ i64_out_size ], ( int32_t )i64_cb_back );
+		if( i_edata_size < 0 )
+		{
+			return -1;
+		}
+		i64_out_size += i_edata_size;
+		i64_pos += i_length;
+		i64_cb_back += i_length;
+	}
+	return i64_out_size;
+}
+
+
+void *mdeflate_enc_worker( void *pv_jobs )
+{
+	int32_t i_job, i_failed;
+	mdeflate_jobs_t *ps_jobs = pv_jobs;
+	mdeflate_compress_t *ps_compress;
+
+	ps_compress = mdeflate_create( ps_jobs->ps_params );
+	i_failed = ps_compress == NULL;
+
+	while( 1 )
+	{
+#if WITH_THREADS
+		pthread_mutex_lock( &ps_jobs->s_mutex );
+#endif
+		if( i_failed )
+		{
+			ps_jobs->i_error = 1;
+		}
+		i_job = ps_jobs->i_error ? ps_jobs->i_num_jobs : ps_jobs->i_next_job++;
+#if WITH_THREADS
+		pthread_mutex_unlock( &ps_jobs->s_mutex );
+#endif
+		if( i_job >= ps_jobs->i_num_jobs )
+		{
+			break;
+		}
+		ps_jobs->pi64_job_size[ i_job ] = mdeflate_enc_job( ps_compress, ps_jobs, i_job );
+		i_failed = ps_jobs->pi64_job_size[ i_job ] < 0;
+	}
+
+	if( ps_compress != NULL )
+	{
+		mdeflate_destroy( ps_compress );
+	}
+	return NULL;
+}
+
+
+int64_t mdeflate_enc_jobs( uint8_t *pui8_in_data, int64_t i64_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back, const mdeflate_params_t *ps_params, int32_t i_threads, int64_t *pi64_job_size )
+{
+	int32_t i_job, i_thread;
+	int64_t i64_out_size, i64_job_stride;
+	mdeflate_jobs_t s_jobs;
+#if WITH_THREADS
+	pthread_t rgs_threads[ MDEFLATE_MAX_THREADS ];
+#endif
+
+	memset( &s_jobs, 0, sizeof( s_jobs ) );
+	s_jobs.ps_params = ps_params;
+	s_jobs.pui8_in_data = pui8_in_data;
+	s_jobs.i64_in_data_length = i64_in_data_length;
+	s_jobs.i_cb_back = i_cb_back;
+	s_jobs.pui8_out_data = pui8_out_data;
+	mdeflate_init_format( &s_jobs.s_format, ps_params->i_window_log, ps_params->i_block_log );
+	s_jobs.i_job_blocks = ps_params->i_reset_blocks > 0 ? ps_params->i_reset_blocks : MDEFLATE_JOB_BLOCKS;
+	s_jobs.i_num_jobs = ( int32_t )( ( i64_in_data_length + ( int64_t )s_jobs.i_job_blocks * s_jobs.s_format.i_block_size - 1 ) / ( ( int64_t )s_jobs.i_job_blocks * s_jobs.s_format.i_block_size ) );
+	if( s_jobs.i_num_jobs == 0 )
+	{
+		return 0;
+	}
+	s_jobs.pi64_job_size = pi64_job_size;
+	if( pi64_job_size == NULL )
+	{
+		s_jobs.pi64_job_size = malloc( sizeof( int64_t ) * s_jobs.i_num_jobs );
+		if( s_jobs.pi64_job_size == NULL )
+		{
+			return -1;
+		}
+	}
+
+	if( i_threads > s_jobs.i_num_jobs )
+	{
+		i_threads = s_jobs.i_num_jobs;
+	}
+	if( i_threads > MDEFLATE_MAX_THREADS )
+	{
+		i_threads = MDEFLATE_MAX_THREADS;
+	}
+
+#if WITH_THREADS
+	pthread_mutex_init( &s_jobs.s_mutex, NULL );
+	for( i_thread = 1; i_thread < i_threads; i_thread++ )
+	{
+		if( pthread_create( &rgs_threads[ i_thread ], NULL, mdeflate_enc_worker, &s_jobs ) != 0 )
+		{
+			break;
+		}
+	}
+	i_threads = i_thread;
+	mdeflate_enc_worker( &s_jobs );
+	for( i_thread = 1; i_thread < i_threads; i_thread++ )
+	{
+		pthread_join( rgs_threads[ i_thread ], NULL );
+	}
+	pthread_mutex_destroy( &s_jobs.s_mutex );
+#else
+	( void )i_thread;
+	mdeflate_enc_worker( &s_jobs );
+#endif
+
+	/* jobs were written at their worst case offsets, close the gaps */
+	i64_out_size = 0;
+	i64_job_stride = ( int64_t )s_jobs.i_job_blocks * ( s_jobs.s_format.i_enc_block_bound + s_jobs.s_format.i_length_bytes );
+	for( i_job = 0; i_job < s_jobs.i_num_jobs && !s_jobs.i_error; i_job++ )
+	{
+		memmove( pui8_out_data + i64_out_size, pui8_out_data + i_job * i64_job_stride, s_jobs.pi64_job_size[ i_job ] );
+		i64_out_size += s_jobs.pi64_job_size[ i_job ];
+	}
+	if( pi64_job_size == NULL )
+	{
+		free( s_jobs.pi64_job_size );
+	}
+
+	return s_jobs.i_error ? -1 : i64_out_size;
+}
+
+
+int64_t mdeflate_enc_blocks( uint8_t *pui8_in_data, int64_t i64_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back, const mdeflate_params_t *ps_params, int32_t i_threads )
+{
+	return mdeflate_enc_jobs( pui8_in_data, i64_in_data_length, pui8_out_data, i_cb_back, ps_params, i_threads, NULL );
+}
+
+
+/* worst case size of the length prefixed blocks for i64_length input bytes, without header and terminator */
+int64_t mdeflate_enc_blocks_bound( const mdeflate_params_t *ps_params, int64_t i64_length )
+{
+	mdeflate_format_t s_format;
+
+	mdeflate_init_format( &s_format, ps_params->i_window_log, ps_params->i_block_log );
+	return ( ( i64_length + s_format.i_block_size - 1 ) / s_format.i_block_size ) * ( s_format.i_enc_block_bound + s_format.i_length_bytes );
+}
+
+
+/* ------------------------ FRAME ------------------------ */
+
+
+typedef struct {
+	int64_t i64_uncompressed_offset;
+	int64_t i64_compressed_offset;
+} mdeflate_index_entry_t;
+
+typedef struct {
+	mdeflate_format_t s_format;
+	int64_t i64_uncompressed_size;
+	int64_t i64_compressed_size; /* including the stream header */
+	int32_t i_num_entries;
+	int32_t i_max_entries;
+	mdeflate_index_entry_t *ps_entries;
+} mdeflate_index_t;
+
+
+void mdeflate_init_index( mdeflate_index_t *ps_index )
+{
+	memset( ps_index, 0, sizeof( mdeflate_index_t ) );
+	mdeflate_init_format( &ps_index->s_format, 0, 0 );
+}
+
+
+void mdeflate_free_index( mdeflate_index_t *ps_index )
+{
+	free( ps_index->ps_entries );
+	mdeflate_init_index( ps_index );
+}
+
+
+int32_t mdeflate_index_add( mdeflate_index_t *ps_index, int64_t i64_uncompressed_offset, int64_t i64_compressed_offset )
+{
+	if( ps_index->i_num_entries == ps_index->i_max_entries )
+	{
+		mdeflate_index_entry_t *ps_entries;
+		int32_t i_max_entries = ps_index->i_max_entries > 0 ? ps_index->i_max_entries * 2 : 64;
+
+		ps_entries = realloc( ps_index->ps_entries, sizeof( mdeflate_index_entry_t ) * i_max_entries );
+		if( ps_entries == NULL )
+		{
+			return -1;
+		}
+		ps_index->ps_entries = ps_entries;
+		ps_index->i_max_entries = i_max_entries;
+	}
+	ps_index->ps_entries[ ps_index->i_num_entries ].i64_uncompressed_offset = i64_uncompressed_offset;
+	ps_index->ps_entries[ ps_index->i_num_entries ].i64_compressed_offset = i64_compressed_offset;
+	ps_index->i_num_entries++;
+	return 0;
+}
+
+
+int64_t mdeflate_enc_frame_chunk( mdeflate_index_t *ps_index, uint8_t *pui8_in_data, int64_t i64_in_data_length, uint8_t *pui8_out_data, int32_t i_cb_back, const mdeflate_params_t *ps_params, int32_t i_threads )
+{
+	int32_t i_job, i_num_jobs;
+	int64_t i64_out_size, i64_group_size, i64_compressed_offset, *pi64_job_size;
+
+	mdeflate_init_format( &ps_index->s_format, ps_params->i_window_log, ps_params->i_block_log );
+	if( ps_params->i_reset_blocks <= 0 )
+	{
+		if( ps_index->i_num_entries == 0 && mdeflate_index_add( ps_index, 0, ps_index->i64_compressed_size ) < 0 )
+		{
+			return -1;
+		}
+		i64_out_size = mdeflate_enc_jobs( pui8_in_data, i64_in_data_length, pui8_out_data, i_cb_back, ps_params, i_threads, NULL );
+	}
+	else
+	{
+		i64_group_size = ( int64_t )ps_params->i_reset_blocks * ps_index->s_format.i_block_size;
+		i_num_jobs = ( int32_t )( ( i64_in_data_length + i64_group_size - 1 ) / i64_group_size );
+		pi64_job_size = malloc( sizeof( int64_t ) * ( i_num_jobs + 1 ) );
+		if( pi64_job_size == NULL )
+		{
+			return -1;
+		}
+		i64_out_size = mdeflate_enc_jobs( pui8_in_data, i64_in_data_length, pui8_out_data, 0, ps_params, i_threads, pi64_job_size );
+
+		i64_compressed_offset = ps_index->i64_compressed_size;
+		for( i_job = 0; i_job < i_num_jobs && i64_out_size >= 0; i_job++ )
+		{
+			if( mdeflate_index_add( ps_index, ps_index->i64_uncompressed_size + i_job * i64_group_size, i64_compressed_offset ) < 0 )
+			{
+				i64_out_size = -1;
+			}
+			i64_compressed_offset += pi64_job_size[ i_job ];
+		}
+		free( pi64_job_size );
+	}
+
+	if( i64_out_size >= 0 )
+	{
+		ps_index->i64_uncompressed_size += i64_in_data_length;
+		ps_index->i64_compressed_size += i64_out_size;
+	}
+	return i64_out_size;
+}
+
+
+int64_t mdeflate_write_index( mdeflate_index_t *ps_index, uint8_t *pui8_out )
+{
+	int32_t i_idx;
+
+	for( i_idx = 0; i_idx < ps_index->i_num_entries; i_idx++ )
+	{
+		mdeflate_write_be( pui8_out, ps_index->ps_entries[ i_idx ].i64_uncompressed_offset, 8 );
+		mdeflate_write_be( pui8_out + 8, ps_index->ps_entries[ i_idx ].i64_compressed_offset, 8 );
+		pui8_out += MDEFLATE_INDEX_ENTRY_SIZE;
+	}
+	mdeflate_write_be( pui8_out, ps_index->i64_uncompressed_size, 8 );
+	mdeflate_write_be( pui8_out + 8, ps_index->i_num_entries, 4 );
+	memcpy( pui8_out + 12, "MDIX", 4 );
+
+	return MDEFLATE_INDEX_SIZE( ps_index->i_num_entries );
+}
+
+
+int64_t mdeflate_enc_frame( uint8_t *pui8_in_data, int64_t i64_in_data_length, uint8_t *pui8_out_data, const mdeflate_params_t *ps_params, int32_t i_threads )
+{
+	int64_t i64_out_size;
+	mdeflate_index_t s_index;
+
+	mdeflate_init_index( &s_index );
+	mdeflate_init_format( &s_index.s_format, ps_params->i_window_log, ps_params->i_block_log );
+	s_index.i64_compressed_size = mdeflate_write_header( &s_index.s_format, pui8_out_data );
+	i64_out_size = mdeflate_enc_frame_chunk( &s_index, pui8_in_data, i64_in_data_length, pui8_out_data + s_index.i64_compressed_size, 0, ps_params, i_threads );
+	if( i64_out_size >= 0 )
+	{
+		i64_out_size = s_index.i64_compressed_size;
+		i64_out_size += mdeflate_write_terminator( &s_index.s_format, pui8_out_data + i64_out_size );
+		i64_out_size += mdeflate_write_index( &s_index, pui8_out_data + i64_out_size );
+	}
+	mdeflate_free_index( &s_index );
+
+	return i64_out_size;
+}
+
+
+int64_t mdeflate_enc_frame_bound( const mdeflate_params_t *ps_params, int64_t i64_length )
+{
+	mdeflate_format_t s_format;
+
+	mdeflate_init_format( &s_format, ps_params->i_window_log, ps_params->i_block_log );
+	return MDEFLATE_HEADER_SIZE + mdeflate_enc_blocks_bound( ps_params, i64_length ) + s_format.i_length_bytes + MDEFLATE_INDEX_SIZE( i64_length / s_format.i_block_size + 1 );
+}
+
+
+int32_t minflate_read_index( uint8_t *pui8_frame, int64_t i64_frame_length, mdeflate_index_t *ps_index )
+{
+	int32_t i_idx, i_num_entries;
+	int64_t i64_uncompressed_offset, i64_compressed_offset, i64_entry_uncompressed, i64_entry_compressed;
+	uint8_t *pui8_entries;
+
+	mdeflate_init_index( ps_index );
+	if( i64_frame_length < MDEFLATE_INDEX_TRAILER_SIZE || memcmp( pui8_frame + i64_frame_length - 4, "MDIX", 4 ) != 0 )
+	{
+		return -1;
+	}
+	i64_compressed_offset = minflate_read_header( &ps_index->s_format, pui8_frame, i64_frame_length );
+	i_num_entries = ( int32_t )mdeflate_read_be( pui8_frame + i64_frame_length - 8, 4 );
+	ps_index->i64_uncompressed_size = ( int64_t )mdeflate_read_be( pui8_frame + i64_frame_length - 16, 8 );
+	if( i64_compressed_offset < 0 || i_num_entries < 0 || MDEFLATE_INDEX_SIZE( i_num_entries ) > i64_frame_length || ps_index->i64_uncompressed_size < 0 )
+	{
+		return -1;
+	}
+	ps_index->i64_compressed_size = i64_frame_length - MDEFLATE_INDEX_SIZE( i_num_entries );
+
+	/* the entries come from the frame, only take them if both offsets grow and stay inside the frame */
+	i64_uncompressed_offset = 0;
+	pui8_entries = pui8_frame + ps_index->i64_compressed_size;
+	for( i_idx = 0; i_idx < i_num_entries; i_idx++ )
+	{
+		i64_entry_uncompressed = ( int64_t )mdeflate_read_be( pui8_entries, 8 );
+		i64_entry_compressed = ( int64_t )mdeflate_read_be( pui8_entries + 8, 8 );
+		if( i64_entry_uncompressed < i64_uncompressed_offset || i64_entry_uncompressed > ps_index->i64_uncompressed_size ||
+			i64_entry_compressed < i64_compressed_offset || ( i_idx > 0 && i64_entry_compressed == i64_compressed_offset ) ||
+			i64_entry_compressed >= ps_index->i64_compressed_size || mdeflate_index_add( ps_index, i64_entry_uncompressed, i64_entry_compressed ) < 0 )
+		{
+			break;
+		}
+		i64_uncompressed_offset = i64_entry_uncompressed;
+		i64_compressed_offset = i64_entry_compressed;
+		pui8_entries += MDEFLATE_INDEX_ENTRY_SIZE;
+	}
+	if( i_idx < i_num_entries )
+	{
+		mdeflate_free_index( ps_index );
+		return -1;
+	}
+	return 0;
+}
+
+
+int64_t minflate_dec_range( uint8_t *pui8_frame, mdeflate_index_t *ps_index, int64_t i64_offset, int64_t i64_length, uint8_t *pui8_out_data )
+{
+	int32_t i_entry, i_block_size, i_ddata_size, i_length_bytes, i_history, i_dpos, i_ddata_end;
+	int64_t i64_pos, i64_frame_pos, i64_out_size, i64_copy_start, i64_copy_end;
+	uint8_t *pui8_ddata;
+	minflate_uncompress_t *ps_uncompress;
+	mdeflate_format_t *ps_format = &ps_index->s_format;
+
+	if( i64_offset < 0 || i64_offset >= ps_index->i64_uncompressed_size || ps_index->i_num_entries == 0 )
+	{
+		return 0;
+	}
+	if( i64_length > ps_index->i64_uncompressed_size - i64_offset )
+	{
+		i64_length = ps_index->i64_uncompressed_size - i64_offset;
+	}
+
+	for( i_entry = ps_index->i_num_entries - 1; i_entry > 0; i_entry-- )
+	{
+		if( ps_index->ps_entries[ i_entry ].i64_uncompressed_offset <= i64_offset )
+		{
+			break;
+		}
+	}
+	i64_pos = ps_index->ps_entries[ i_entry ].i64_uncompressed_offset;
+	i64_frame_pos = ps_index->ps_entries[ i_entry ].i64_compressed_offset;
+
+	/* the scratch buffer holds two windows in front of the block, so the last window of history is moved down
+	   only once every window size bytes */
+	i_history = ps_format->i_window_size;
+	i_length_bytes = ps_format->i_length_bytes;
+	i_ddata_end = 2 * i_history + ps_format->i_block_size;
+	pui8_ddata = malloc( ( size_t )i_ddata_end );
+	if( pui8_ddata == NULL )
+	{
+		return -1;
+	}
+	/* index entries start where the compressor forgot its tables */
+	ps_uncompress = minflate_create( ps_format );
+	if( ps_uncompress == NULL )
+	{
+		free( pui8_ddata );
+		return -1;
+	}
+
+	i64_out_size = 0;
+	i_dpos = 0;
+	while( i64_out_size < i64_length && i64_frame_pos + i_length_bytes <= ps_index->i64_compressed_size )
+	{
+		i_block_size = ( int32_t )mdeflate_read_be( pui8_frame + i64_frame_pos, i_length_bytes );
+		if( i_block_size <= 0 || i_block_size > ps_format->i_enc_block_bound || i64_frame_pos + i_length_bytes + i_block_size > ps_index->i64_compressed_size )
+		{
+			break;
+		}
+		if( i_dpos + ps_format->i_block_size > i_ddata_end )
+		{
+			memmove( &pui8_ddata[ 0 ], &pui8_ddata[ i_dpos - i_history ], i_history );
+			i_dpos = i_history;
+		}
+		i_ddata_size = minflate_dec_block_ctx( ps_uncompress, pui8_frame + i64_frame_pos + i_length_bytes, i_block_size, &pui8_ddata[ i_dpos ], &pui8_ddata[ i_dpos + ps_format->i_block_size ] );
+		if( i_ddata_size < 0 )
+		{
+			break;
+		}
+		i64_frame_pos += i_block_size + i_length_bytes;
+
+		i64_copy_start = i64_offset + i64_out_size - i64_pos;
+		i64_copy_end = i64_offset + i64_length - i64_pos;
+		if( i64_copy_end > i_ddata_size )
+		{
+			i64_copy_end = i_ddata_size;
+		}
+		if( i64_copy_start < i64_copy_end )
+		{
+			memcpy( pui8_out_data + i64_out_size, &pui8_ddata[ i_dpos + i64_copy_start ], ( size_t )( i64_copy_end - i64_copy_start ) );
+			i64_out_size += i64_copy_end - i64_copy_start;
+		}
+		i64_pos += i_ddata_size;
+		i_dpos += i_ddata_size;
+	}
+	minflate_destroy( ps_uncompress );
+	free( pui8_ddata );
+
+	/* a corrupt block or a frame that ends early leaves the range short */
+	if( i64_out_size < i64_length )
+	{
+		return -1;
+	}
+	return i64_out_size;
+}
+
+
+typedef struct {
+	uint8_t *pui8_frame;
+	mdeflate_index_t *ps_index;
+	int32_t i_first_group;
+	int32_t i_num_groups;
+	uint8_t *pui8_out_data;
+
+	int32_t i_next_group;
+	int32_t i_error;
+#if WITH_THREADS
+	pthread_mutex_t s_mutex;
+#endif
+} minflate_groups_t;
+
+
+int64_t minflate_group_size( mdeflate_index_t *ps_index, int32_t i_group )
+{
+	if( i_group + 1 < ps_index->i_num_entries )
+	{
+		return ps_index->ps_entries[ i_group + 1 ].i64_uncompressed_offset - ps_index->ps_entries[ i_group ].i64_uncompressed_offset;
+	}
+	return ps_index->i64_uncompressed_size - ps_index->ps_entries[ i_group ].i64_uncompressed_offset;
+}
+
+
+int32_t minflate_dec_group( minflate_groups_t *ps_groups, int32_t i_group )
+{
+	int32_t i_block_size, i_length_bytes, i_ddata_size;
+	int64_t i64_frame_pos, i64_frame_end, i64_pos, i64_size;
+	uint8_t *pui8_out;
+	minflate_uncompress_t s_uncompress;
+	mdeflate_index_t *ps_index = ps_groups->ps_index;
+
+	i_length_bytes = ps_index->s_format.i_length_bytes;
+	i64_frame_pos = ps_index->ps_entries[ i_group ].i64_compressed_offset;
+	i64_frame_end = i_group + 1 < ps_index->i_num_entries ? ps_index->ps_entries[ i_group + 1 ].i64_compressed_offset : ps_index->i64_compressed_size;
+	pui8_out = ps_groups->pui8_out_data + ( ps_index->ps_entries[ i_group ].i64_uncompressed_offset - ps_index->ps_entries[ ps_groups->i_first_group ].i64_uncompressed_offset );
+	i64_size = minflate_group_size( ps_index, i_group );
+	minflate_init( &s_uncompress, &ps_index->s_format );
+
+	i64_pos = 0;
+	while( i64_pos < i64_size && i64_frame_pos + i_length_bytes <= i64_frame_end )
+	{
+		i_block_size = ( int32_t )mdeflate_read_be( ps_groups->pui8_frame + i64_frame_pos, i_length_bytes );
+		if( i_block_size <= 0 || i64_frame_pos + i_length_bytes + i_block_size > i64_frame_end )
+		{
+			break;
+		}
+		i_ddata_size = minflate_dec_block_ctx( &s_uncompress, ps_groups->pui8_frame + i64_frame_pos + i_length_bytes, i_block_size, pui8_out + i64_pos, pui8_out + i64_size );
+		if( i_ddata_size < 0 )
+		{
+			return -1;
+		}
+		i64_pos += i_ddata_size;
+		i64_frame_pos += i_block_size + i_length_bytes;
+	}
+	return i64_pos == i64_size ? 0 : -1;
+}
+
+
+void *minflate_dec_worker( void *pv_groups )
+{
+	int32_t i_group, i_failed;
+	minflate_groups_t *ps_groups = pv_groups;
+
+	i_failed = 0;
+	while( 1 )
+	{
+#if WITH_THREADS
+		pthread_mutex_lock( &ps_groups->s_mutex );
+#endif
+		if( i_failed )
+		{
+			ps_groups->i_error = 1;
+		}
+		i_group = ps_groups->i_error ? ps_groups->i_first_group + ps_groups->i_num_groups : ps_groups->i_next_group++;
+#if WITH_THREADS
+		pthread_mutex_unlock( &ps_groups->s_mutex );
+#endif
+		if( i_group >= ps_groups->i_first_group + ps_groups->i_num_groups )
+		{
+			break;
+		}
+		i_failed = minflate_dec_group( ps_groups, i_group ) < 0;
+	}
+	return NULL;
+}
+
+
+int64_t minflate_dec_groups( uint8_t *pui8_frame, mdeflate_index_t *ps_index, int32_t i_first_group, int32_t i_num_groups, uint8_t *pui8_out_data, int32_t i_threads )
+{
+	int32_t i_thread;
+	int64_t i64_out_size;
+	minflate_groups_t s_groups;
+#if WITH_THREADS
+	pthread_t rgs_threads[ MDEFLATE_MAX_THREADS ];
+#endif
+
+	if( i_first_group < 0 || i_first_group + i_num_groups > ps_index->i_num_entries )
+	{
+		return -1;
+	}
+	if( i_num_groups <= 0 )
+	{
+		return 0;
+	}
+
+	memset( &s_groups, 0, sizeof( s_groups ) );
+	s_groups.pui8_frame = pui8_frame;
+	s_groups.ps_index = ps_index;
+	s_groups.i_first_group = i_first_group;
+	s_groups.i_num_groups = i_num_groups;
+	s_groups.pui8_out_data = pui8_out_data;
+	s_groups.i_next_group = i_first_group;
+
+	if( i_threads > i_num_groups )
+	{
+		i_threads = i_num_groups;
+	}
+	if( i_threads > MDEFLATE_MAX_THREADS )
+	{
+		i_threads = MDEFLATE_MAX_THREADS;
+	}
+
+#if WITH_THREADS
+	pthread_mutex_init( &s_groups.s_mutex, NULL );
+	for( i_thread = 1; i_thread < i_threads; i_thread++ )
+	{
+		if( pthread_create( &rgs_threads[ i_thread ], NULL, minflate_dec_worker, &s_groups ) != 0 )
+		{
+			break;
+		}
+	}
+	i_threads = i_thread;
+	minflate_dec_worker( &s_groups );
+	for( i_thread = 1; i_thread < i_threads; i_thread++ )
+	{
+		pthread_join( rgs_threads[ i_thread ], NULL );
+	}
+	pthread_mutex_destroy( &s_groups.s_mutex );
+#else
+	( void )i_thread;
+	minflate_dec_worker( &s_groups );
+#endif
+
+	i64_out_size = ps_index->ps_entries[ i_first_group + i_num_groups - 1 ].i64_uncompressed_offset - ps_index->ps_entries[ i_first_group ].i64_uncompressed_offset;
+	i64_out_size += minflate_group_size( ps_index, i_first_group + i_num_groups - 1 );
+
+	return s_groups.i_error ? -1 : i64_out_size;
+}
+
+
+int64_t minflate_dec_frame( uint8_t *pui8_frame, mdeflate_index_t *ps_index, uint8_t *pui8_out_data, int32_t i_threads )
+{
+	return minflate_dec_groups( pui8_frame, ps_index, 0, ps_index->i_num_entries, pui8_out_data, i_threads );
+}
+
+
+/* ------------------------ STREAM ------------------------ */
+
+/* the streams keep their history in a buffer of two windows and four blocks. once a block does not fit
+   anymore the last window is moved to the front, so matches never wrap around */
+
+typedef struct {
+	mdeflate_compress_t *ps_compress;
+	uint8_t *pui8_window;
+	int32_t i_window_buffer_size;
+	int32_t i_pos; /* start of the data which is not compressed yet */
+	int32_t i_end;
+	int32_t i_num_blocks;
+	int32_t i_finished;
+
+	uint8_t *pui8_pending;
+	int32_t i_pending_pos;
+	int32_t i_pending_size;
+} mdeflate_stream_t;
+
+
+int32_t mdeflate_stream_buffer_size( const mdeflate_format_t *ps_format )
+{
+	return 2 * ps_format->i_window_size + 4 * ps_format->i_block_size;
+}
+
+
+void mdeflate_stream_destroy( mdeflate_stream_t *ps_stream )
+{
+	if( ps_stream->ps_compress )
+	{
+		mdeflate_destroy( ps_stream->ps_compress );
+	}
+	free( ps_stream->pui8_window );
+	free( ps_stream->pui8_pending );
+	free( ps_stream );
+}
+
+
+mdeflate_stream_t *mdeflate_stream_create( const mdeflate_params_t *ps_params )
+{
+	mdeflate_stream_t *ps_stream;
+	mdeflate_format_t *ps_format;
+
+	ps_stream = malloc( sizeof( mdeflate_stream_t ) );
+	if( ps_stream == NULL )
+	{
+		return NULL;
+	}
+	memset( ps_stream, 0, sizeof( mdeflate_stream_t ) );
+	ps_stream->ps_compress = mdeflate_create( ps_params );
+	if( ps_stream->ps_compress == NULL )
+	{
+		mdeflate_stream_destroy( ps_stream );
+		return NULL;
+	}
+	ps_format = &ps_stream->ps_compress->s_format;
+	ps_stream->i_window_buffer_size = mdeflate_stream_buffer_size( ps_format );
+	ps_stream->pui8_window = malloc( ps_stream->i_window_buffer_size );
+	ps_stream->pui8_pending = malloc( ps_format->i_enc_block_bound + ps_format->i_length_bytes );
+	if( ps_stream->pui8_window == NULL || ps_stream->pui8_pending == NULL )
+	{
+		mdeflate_stream_destroy( ps_stream );
+		return NULL;
+	}
+	ps_stream->i_pending_size = mdeflate_write_header( ps_format, ps_stream->pui8_pending );
+	return ps_stream;
+}
+
+
+int32_t mdeflate_stream_enc_block( mdeflate_stream_t *ps_stream )
+{
+	int32_t i_cb_back, i_edata_size, i_reset_blocks;
+	mdeflate_format_t *ps_format = &ps_stream->ps_compress->s_format;
+
+	i_cb_back = ps_stream->i_pos < ps_format->i_window_size ? ps_stream->i_pos : ps_format->i_window_size;
+	i_reset_blocks = ps_stream->ps_compress->s_params.i_reset_blocks;
+	if( i_reset_blocks > 0 && ps_stream->i_num_blocks % i_reset_blocks == 0 )
+	{
+		i_cb_back = 0;
+	}
+	/* forget the tables where mdeflate_enc_blocks starts a job so both produce the same stream */
+	if( ps_stream->i_num_blocks % ( i_reset_blocks > 0 ? i_reset_blocks : MDEFLATE_JOB_BLOCKS ) == 0 )
+	{
+		mdeflate_reset( ps_stream->ps_compress );
+	}
+
+	i_edata_size = mdeflate_enc_blocks_ctx( ps_stream->ps_compress, ps_stream->pui8_window + ps_stream->i_pos, ps_stream->i_end - ps_stream->i_pos, ps_stream->pui8_pending, i_cb_back );
+	if( i_edata_size < 0 )
+	{
+		return -1;
+	}
+	ps_stream->i_pending_pos = 0;
+	ps_stream->i_pending_size = i_edata_size;
+	ps_stream->i_pos = ps_stream->i_end;
+	ps_stream->i_num_blocks++;
+
+	return 0;
+}
+
+
+/* consumes input and produces output until one of them runs out. i_flush MDEFLATE_STREAM_FLUSH compresses
+   buffered input as a short block, MDEFLATE_STREAM_FINISH does the same and writes the terminator.
+   returns 1 once the flush or finish is complete, 0 if it has to be called again with more output space or
+   more input and -1 on error. */
+int32_t mdeflate_stream_compress( mdeflate_stream_t *ps_stream, uint8_t *pui8_in, int32_t i_in_length, int32_t *pi_in_used, uint8_t *pui8_out, int32_t i_out_length, int32_t *pi_out_used, int32_t i_flush )
+{
+	int32_t i_in_used, i_out_used, i_copy, i_keep, i_block_size, i_window_size;
+
+	i_block_size = ps_stream->ps_compress->s_format.i_block_size;
+	i_window_size = ps_stream->ps_compress->s_format.i_window_size;
+	i_in_used = i_out_used = 0;
+	while( 1 )
+	{
+		i_copy = ps_stream->i_pending_size - ps_stream->i_pending_pos;
+		if( i_copy > i_out_length - i_out_used )
+		{
+			i_copy = i_out_length - i_out_used;
+		}
+		memcpy( pui8_out + i_out_used, &ps_stream->pui8_pending[ ps_stream->i_pending_pos ], i_copy );
+		ps_stream->i_pending_pos += i_copy;
+		i_out_used += i_copy;
+		if( ps_stream->i_pending_pos < ps_stream->i_pending_size || ps_stream->i_finished )
+		{
+			break;
+		}
+
+		if( ps_stream->i_pos + i_block_size > ps_stream->i_window_buffer_size )
+		{
+			i_keep = ps_stream->i_pos < i_window_size ? ps_stream->i_pos : i_window_size;
+			memmove( ps_stream->pui8_window, ps_stream->pui8_window + ps_stream->i_pos - i_keep, ps_stream->i_end - ps_stream->i_pos + i_keep );
+			ps_stream->i_end -= ps_stream->i_pos - i_keep;
+			ps_stream->i_pos = i_keep;
+			ps_stream->ps_compress->pui8_hash_end = NULL; /* the hash chains point into the old place */
+		}
+
+		i_copy = ps_stream->i_pos + i_block_size - ps_stream->i_end;
+		if( i_copy > i_in_length - i_in_used )
+		{
+			i_copy = i_in_length - i_in_used;
+		}
+		memcpy( ps_stream->pui8_window + ps_stream->i_end, pui8_in + i_in_used, i_copy );
+		ps_stream->i_end += i_copy;
+		i_in_used += i_copy;
+
+		if( ps_stream->i_end - ps_stream->i_pos == i_block_size || ( i_flush != MDEFLATE_STREAM_NO_FLUSH && i_in_used == i_in_length && ps_stream->i_end > ps_stream->i_pos ) )
+		{
+			if( mdeflate_stream_enc_block( ps_stream ) < 0 )
+			{
+				return -1;
+			}
+		}
+		else if( i_flush == MDEFLATE_STREAM_FINISH && i_in_used == i_in_length )
+		{
+			ps_stream->i_pending_pos = 0;
+			ps_stream->i_pending_size = mdeflate_write_terminator( &ps_stream->ps_compress->s_format, ps_stream->pui8_pending );
+			ps_stream->i_finished = 1;
+		}
+		else if( i_in_used == i_in_length )
+		{
+			break;
+		}
+	}
+
+	*pi_in_used = i_in_used;
+	*pi_out_used = i_out_used;
+	if( ps_stream->i_pending_pos < ps_stream->i_pending_size || i_in_used < i_in_length )
+	{
+		return 0;
+	}
+	if( i_flush == MDEFLATE_STREAM_FINISH )
+	{
+		return ps_stream->i_finished;
+	}
+	return i_flush == MDEFLATE_STREAM_FLUSH ? 1 : 0;
+}
+
+
+typedef struct {
+	mdeflate_format_t s_format;
+	uint8_t rgui8_header[ MDEFLATE_HEADER_SIZE ];
+	int32_t i_header_fill;
+
+	uint8_t *pui8_window; /* allocated once the header is known */
+	int32_t i_window_buffer_size;
+	int32_t i_pos; /* end of the decompressed data */
+	int32_t i_out_pos; /* start of the decompressed data not handed out yet */
+	int32_t i_finished;
+
+	uint8_t *pui8_block;
+	int32_t i_block_fill;
+	minflate_uncompress_t *ps_uncompress;
+} minflate_stream_t;
+
+
+minflate_stream_t *minflate_stream_create( void )
+{
+	minflate_stream_t *ps_stream;
+
+	ps_stream = malloc( sizeof( minflate_stream_t ) );
+	if( ps_stream == NULL )
+	{
+		return NULL;
+	}
+	memset( ps_stream, 0, sizeof( minflate_stream_t ) );
+	return ps_stream;
+}
+
+
+void minflate_stream_destroy( minflate_stream_t *ps_stream )
+{
+	free( ps_stream->pui8_window );
+	free( ps_stream->pui8_block );
+	if( ps_stream->ps_uncompress != NULL )
+	{
+		minflate_destroy( ps_stream->ps_uncompress );
+	}
+	free( ps_stream );
+}
+
+
+/* gathers the stream header or the length prefix of the first legacy block, returns the bytes used or -1 */
+int32_t minflate_stream_read_header( minflate_stream_t *ps_stream, uint8_t *pui8_in, int32_t i_in_length )
+{
+	int32_t i_in_used, i_header_size;
+	mdeflate_format_t *ps_format = &ps_stream->s_format;
+
+	i_in_used = 0;
+	while( 1 )
+	{
+		i_header_size = ps_stream->i_header_fill >= 2 && ps_stream->rgui8_header[ 0 ] == 'M' && ps_stream->rgui8_header[ 1 ] == 'D' ? MDEFLATE_HEADER_SIZE : 2;
+		if( ps_stream->i_header_fill == i_header_size || i_in_used == i_in_length )
+		{
+			break;
+		}
+		ps_stream->rgui8_header[ ps_stream->i_header_fill++ ] = pui8_in[ i_in_used++ ];
+	}
+	if( ps_stream->i_header_fill < i_header_size )
+	{
+		return i_in_used;
+	}
+
+	if( minflate_read_header( ps_format, ps_stream->rgui8_header, ps_stream->i_header_fill ) < 0 )
+	{
+		return -1;
+	}
+	ps_stream->i_window_buffer_size = mdeflate_stream_buffer_size( ps_format );
+	ps_stream->pui8_window = malloc( ps_stream->i_window_buffer_size + MINFLATE_OUT_SLACK );
+	ps_stream->pui8_block = malloc( ps_format->i_enc_block_bound + ps_format->i_length_bytes );
+	ps_stream->ps_uncompress = minflate_create( ps_format );
+	if( ps_stream->pui8_window == NULL || ps_stream->pui8_block == NULL || ps_stream->ps_uncompress == NULL )
+	{
+		return -1;
+	}
+	if( ps_format->i_window_log == 0 )
+	{
+		memcpy( ps_stream->pui8_block, ps_stream->rgui8_header, 2 );
+		ps_stream->i_block_fill = 2;
+	}
+	return i_in_used;
+}
+
+
+/* consumes length prefixed blocks and hands out their data. returns 1 once the terminator was read and all
+   data was handed out, 0 if it has to be called again with more input or output space and -1 on error.
+   blocks which are complete in pui8_in are decoded from there without copying them. */
+int32_t minflate_stream_decompress( minflate_stream_t *ps_stream, uint8_t *pui8_in, int32_t i_in_length, int32_t *pi_in_used, uint8_t *pui8_out, int32_t i_out_length, int32_t *pi_out_used )
+{
+	int32_t i_in_used, i_out_used, i_copy, i_keep, i_block_size, i_ddata_size, i_length_bytes;
+	uint8_t *pui8_block;
+	mdeflate_format_t *ps_format = &ps_stream->s_format;
+
+	i_in_used = i_out_used = 0;
+	while( 1 )
+	{
+		i_copy = ps_stream->i_pos - ps_stream->i_out_pos;
+		if( i_copy > i_out_length - i_out_used )
+		{
+			i_copy = i_out_length - i_out_used;
+		}
+		if( i_copy > 0 )
+		{
+			memcpy( pui8_out + i_out_used, ps_stream->pui8_window + ps_stream->i_out_pos, i_copy );
+		}
+		ps_stream->i_out_pos += i_copy;
+		i_out_used += i_copy;
+		if( ps_stream->i_out_pos < ps_stream->i_pos || ps_stream->i_finished )
+		{
+			break;
+		}
+
+		if( ps_stream->pui8_window == NULL )
+		{
+			i_copy = minflate_stream_read_header( ps_stream, pui8_in + i_in_used, i_in_length - i_in_used );
+			if( i_copy < 0 )
+			{
+				return -1;
+			}
+			i_in_used += i_copy;
+			if( ps_stream->pui8_window == NULL )
+			{
+				break;
+			}
+		}
+		i_length_bytes = ps_format->i_length_bytes;
+
+		/* gather the length prefix and the block unless both are complete in the input */
+		if( ps_stream->i_block_fill == 0 && i_in_length - i_in_used >= i_length_bytes &&
+			i_in_length - i_in_used - i_length_bytes >= ( int64_t )mdeflate_read_be( pui8_in + i_in_used, i_length_bytes ) )
+		{
+			pui8_block = pui8_in + i_in_used;
+			i_block_size = ( int32_t )mdeflate_read_be( pui8_block, i_length_bytes );
+			i_in_used += i_block_size + i_length_bytes;
+		}
+		else
+		{
+			i_block_size = ps_stream->i_block_fill >= i_length_bytes ? ( int32_t )mdeflate_read_be( ps_stream->pui8_block, i_length_bytes ) : 0;
+			if( i_block_size < 0 || i_block_size > ps_format->i_enc_block_bound )
+			{
+				return -1;
+			}
+			i_copy = ( ps_stream->i_block_fill < i_length_bytes ? i_length_bytes : i_block_size + i_length_bytes ) - ps_stream->i_block_fill;
+			if( i_copy > i_in_length - i_in_used )
+			{
+				i_copy = i_in_length - i_in_used;
+			}
+			memcpy( &ps_stream->pui8_block[ ps_stream->i_block_fill ], pui8_in + i_in_used, i_copy );
+			ps_stream->i_block_fill += i_copy;
+			i_in_used += i_copy;
+			if( ps_stream->i_block_fill < i_length_bytes )
+			{
+				break;
+			}
+			i_block_size = ( int32_t )mdeflate_read_be( ps_stream->pui8_block, i_length_bytes );
+			if( i_block_size < 0 || i_block_size > ps_format->i_enc_block_bound )
+			{
+				return -1;
+			}
+			if( ps_stream->i_block_fill < i_block_size + i_length_bytes )
+			{
+				if( i_in_used == i_in_length )
+				{
+					break;
+				}
+				continue;
+			}
+			pui8_block = ps_stream->pui8_block;
+			ps_stream->i_block_fill = 0;
+		}
+
+		if( i_block_size < 0 || i_block_size > ps_format->i_enc_block_bound )
+		{
+			return -1;
+		}
+		if( i_block_size == 0 )
+		{
+			ps_stream->i_finished = 1;
+			break;
+		}
+
+		if( ps_stream->i_pos + ps_format->i_block_size > ps_stream->i_window_buffer_size )
+		{
+			i_keep = ps_stream->i_pos < ps_format->i_window_size ? ps_stream->i_pos : ps_format->i_window_size;
+			memmove( ps_stream->pui8_window, ps_stream->pui8_window + ps_stream->i_pos - i_keep, i_keep );
+			ps_stream->i_pos = ps_stream->i_out_pos = i_keep;
+		}
+		i_ddata_size = minflate_dec_block_ctx( ps_stream->ps_uncompress, pui8_block + i_length_bytes, i_block_size, ps_stream->pui8_window + ps_stream->i_pos, ps_stream->pui8_window + ps_stream->i_pos + ps_format->i_block_size + MINFLATE_OUT_SLACK );
+		if( i_ddata_size < 0 || i_ddata_size > ps_format->i_block_size )
+		{
+			return -1;
+		}
+		ps_stream->i_pos += i_ddata_size;
+	}
+
+	*pi_in_used = i_in_used;
+	*pi_out_used = i_out_used;
+	return ps_stream->i_finished && ps_stream->i_out_pos == ps_stream->i_pos ? 1 : 0;
+}
+
+
+/* ------------------------ DICTIONARY ------------------------ */
+
+
+typedef struct {
+	int64_t i64_pos;
+	int64_t i64_score;
+} mdeflate_segment_t;
+
+typedef struct {
+	int64_t i64_total;
+	uint32_t *pui_kmer; /* kmer hash of every sample position */
+	uint32_t *pui_count; /* number of samples a kmer occurs in, the extra bucket stands for positions without a kmer and stays 0 */
+	uint32_t *pui_last; /* last sample a kmer was counted for */
+	uint16_t *pui16_active; /* occurrences in the segment being scored */
+	mdeflate_segment_t *ps_segments;
+} mdeflate_train_t;
+
+
+uint32_t mdeflate_train_hash( uint8_t *pui8_data )
+{
+	uint64_t ui64_key;
+	int32_t i_idx;
+
+	ui64_key = 0;
+	for( i_idx = 0; i_idx < MDEFLATE_TRAIN_KMER; i_idx++ )
+	{
+		ui64_key = ( ui64_key << 8 ) | pui8_data[ i_idx ];
+	}
+	return ( uint32_t )( ( ui64_key * 0x9e3779b97f4a7c15ULL ) >> ( 64 - MDEFLATE_TRAIN_HASH_BITS ) );
+}
+
+
+int mdeflate_compare_segments( const void *pv_a, const void *pv_b )
+{
+	const mdeflate_segment_t *ps_a = pv_a, *ps_b = pv_b;
+
+	if( ps_a->i64_score != ps_b->i64_score )
+	{
+		return ps_a->i64_score < ps_b->i64_score ? -1 : 1;
+	}
+	return ps_a->i64_pos < ps_b->i64_pos ? -1 : ( ps_a->i64_pos > ps_b->i64_pos ? 1 : 0 );
+}
+
+
+void mdeflate_train_free( mdeflate_train_t *ps_train )
+{
+	free( ps_train->pui_kmer );
+	free( ps_train->pui_count );
+	free( ps_train->pui_last );
+	free( ps_train->pui16_active );
+	free( ps_train->ps_segments );
+}
+
+
+/* counts every kmer once per sample it occurs in, kmers of a single sample are of no use for other messages */
+void mdeflate_train_count( mdeflate_train_t *ps_train, uint8_t *pui8_samples, const int32_t *pi_sample_lengths, int32_t i_num_samples )
+{
+	int64_t i64_pos, i64_sample_end;
+	int32_t i_sample;
+	uint32_t ui_hash;
+
+	i64_pos = 0;
+	for( i_sample = 0; i_sample < i_num_samples; i_sample++ )
+	{
+		i64_sample_end = i64_pos + pi_sample_lengths[ i_sample ];
+		for( ; i64_pos < i64_sample_end; i64_pos++ )
+		{
+			if( i64_pos + MDEFLATE_TRAIN_KMER > i64_sample_end )
+			{
+				ps_train->pui_kmer[ i64_pos ] = 1 << MDEFLATE_TRAIN_HASH_BITS;
+				continue;
+			}
+			ui_hash = mdeflate_train_hash( &pui8_samples[ i64_pos ] );
+			ps_train->pui_kmer[ i64_pos ] = ui_hash;
+			if( ps_train->pui_last[ ui_hash ] != ( uint32_t )i_sample + 1 )
+			{
+				ps_train->pui_last[ ui_hash ] = i_sample + 1;
+				ps_train->pui_count[ ui_hash ]++;
+			}
+		}
+	}
+	for( ui_hash = 0; ui_hash < 1 << MDEFLATE_TRAIN_HASH_BITS; ui_hash++ )
+	{
+		if( ps_train->pui_count[ ui_hash ] < 2 )
+		{
+			ps_train->pui_count[ ui_hash ] = 0;
+		}
+	}
+}
+
+
+/* cuts the samples into one epoch per dictionary segment and picks the segment whose distinct kmers score most in
+   each epoch. the kmers of a picked segment score nothing for the following epochs. returns the number of segments */
+int32_t mdeflate_train_pick( mdeflate_train_t *ps_train, int32_t i_max_segments )
+{
+	int64_t i64_pos, i64_first, i64_epoch, i64_epoch_length, i64_epoch_end, i64_score, i64_best_score, i64_best_pos;
+	int32_t i_window, i_num_segments;
+	uint32_t *pui_kmer, *pui_count;
+	uint16_t *pui16_active;
+
+	pui_kmer = ps_train->pui_kmer;
+	pui_count = ps_train->pui_count;
+	pui16_active = ps_train->pui16_active;
+	i_window = MDEFLATE_TRAIN_SEGMENT - MDEFLATE_TRAIN_KMER + 1; /* kmers starting in a segment */
+	i64_epoch_length = ps_train->i64_total / i_max_segments;
+	if( i64_epoch_length < MDEFLATE_TRAIN_SEGMENT )
+	{
+		i64_epoch_length = MDEFLATE_TRAIN_SEGMENT;
+	}
+
+	i_num_segments = 0;
+	for( i64_epoch = 0; i64_epoch + MDEFLATE_TRAIN_SEGMENT <= ps_train->i64_total && i_num_segments < i_max_segments; i64_epoch += i64_epoch_length )
+	{
+		i64_epoch_end = i64_epoch + i64_epoch_length < ps_train->i64_total ? i64_epoch + i64_epoch_length : ps_train->i64_total;
+		i64_score = i64_best_score = 0;
+		i64_best_pos = -1;
+		i64_first = i64_epoch;
+		for( i64_pos = i64_epoch; i64_pos <= i64_epoch_end - MDEFLATE_TRAIN_KMER; i64_pos++ )
+		{
+			if( pui16_active[ pui_kmer[ i64_pos ] ]++ == 0 )
+			{
+				i64_score += pui_count[ pui_kmer[ i64_pos ] ];
+			}
+			if( i64_pos - i64_first + 1 == i_window )
+			{
+				if( i64_score > i64_best_score )
+				{
+					i64_best_score = i64_score;
+					i64_best_pos = i64_first;
+				}
+				if( --pui16_active[ pui_kmer[ i64_first ] ] == 0 )
+				{
+					i64_score -= pui_count[ pui_kmer[ i64_first ] ];
+				}
+				i64_first++;
+			}
+		}
+		for( ; i64_first < i64_pos; i64_first++ )
+		{
+			pui16_active[ pui_kmer[ i64_first ] ] = 0;
+		}
+
+		if( i64_best_pos >= 0 )
+		{
+			ps_train->ps_segments[ i_num_segments ].i64_pos = i64_best_pos;
+			ps_train->ps_segments[ i_num_segments ].i64_score = i64_best_score;
+			i_num_segments++;
+			for( i64_pos = i64_best_pos; i64_pos < i64_best_pos + i_window; i64_pos++ )
+			{
+				pui_count[ pui_kmer[ i64_pos ] ] = 0;
+			}
+		}
+	}
+	return i_num_segments;
+}
+
+
+/* builds a dictionary of up to i_dict_size bytes from samples stored one after another in pui8_samples. the segments
+   are written in order of their score, so the most useful ones end up at the end of the dictionary where offsets are
+   shortest. returns the dictionary length or -1 if out of memory */
+int32_t mdeflate_train_dict( uint8_t *pui8_samples, const int32_t *pi_sample_lengths, int32_t i_num_samples, uint8_t *pui8_dict, int32_t i_dict_size )
+{
+	mdeflate_train_t s_train;
+	int32_t i_sample, i_max_segments, i_num_segments, i_segment;
+
+	memset( &s_train, 0, sizeof( s_train ) );
+	for( i_sample = 0; i_sample < i_num_samples; i_sample++ )
+	{
+		s_train.i64_total += pi_sample_lengths[ i_sample ];
+	}
+	i_max_segments = i_dict_size / MDEFLATE_TRAIN_SEGMENT;
+	if( s_train.i64_total < MDEFLATE_TRAIN_SEGMENT || i_max_segments < 1 )
+	{
+		return 0;
+	}
+
+	s_train.pui_kmer = malloc( ( size_t )s_train.i64_total * sizeof( uint32_t ) );
+	s_train.pui_count = calloc( ( 1 << MDEFLATE_TRAIN_HASH_BITS ) + 1, sizeof( uint32_t ) );
+	s_train.pui_last = calloc( 1 << MDEFLATE_TRAIN_HASH_BITS, sizeof( uint32_t ) );
+	s_train.pui16_active = calloc( ( 1 << MDEFLATE_TRAIN_HASH_BITS ) + 1, sizeof( uint16_t ) );
+	s_train.ps_segments = malloc( ( size_t )i_max_segments * sizeof( mdeflate_segment_t ) );
+	if( s_train.pui_kmer == NULL || s_train.pui_count == NULL || s_train.pui_last == NULL || s_train.pui16_active == NULL || s_train.ps_segments == NULL )
+	{
+		mdeflate_train_free( &s_train );
+		return -1;
+	}
+
+	mdeflate_train_count( &s_train, pui8_samples, pi_sample_lengths, i_num_samples );
+	i_num_segments = mdeflate_train_pick( &s_train, i_max_segments );
+	qsort( s_train.ps_segments, i_num_segments, sizeof( mdeflate_segment_t ), mdeflate_compare_segments );
+	for( i_segment = 0; i_segment < i_num_segments; i_segment++ )
+	{
+		memcpy( pui8_dict + i_segment * MDEFLATE_TRAIN_SEGMENT, pui8_samples + s_train.ps_segments[ i_segment ].i64_pos, MDEFLATE_TRAIN_SEGMENT );
+	}
+	mdeflate_train_free( &s_train );
+	return i_num_segments * MDEFLATE_TRAIN_SEGMENT;
+}
+
+
+/* ------------------------ BENCH ------------------------ */
+
+#if WITH_BENCH
+
+#define MDEFLATE_BENCH_TEXT   0
+#define MDEFLATE_BENCH_BINARY 1
+#define MDEFLATE_BENCH_RUNS   2
+#define MDEFLATE_BENCH_RANDOM 3
+#define MDEFLATE_BENCH_GENERATORS 4
+
+typedef struct {
+	int64_t i64_size;
+	int64_t i64_compressed_size;
+	int32_t i_repeats;
+	int64_t i64_compress_ns; /* fastest run */
+	int64_t i64_decompress_ns;
+	int64_t i64_compress_ticks; /* all runs */
+	int64_t i64_decompress_ticks;
+	int64_t rgi64_stage_ticks[ MDEFLATE_NUM_STAGES ]; /* all runs, only with WITH_STAGE_TIMERS */
+} mdeflate_bench_t;
+
+const char *rgpc_bench_generators[ MDEFLATE_BENCH_GENERATORS ] = { "text", "binary", "runs", "random" };
+const char *rgpc_bench_words[ 32 ] = {
+	"the", "of", "and", "to", "in", "is", "block", "match", "for", "that", "with", "as", "offset", "length", "tree", "on",
+	"literal", "by", "window", "this", "be", "are", "huffman", "from", "at", "or", "decoder", "table", "an", "it", "symbol", "code"
+};
+
+
+int64_t mdeflate_bench_ns( void )
+{
+	struct timespec s_time;
+
+	clock_gettime( CLOCK_MONOTONIC, &s_time );
+	return ( int64_t )s_time.tv_sec * 1000000000 + s_time.tv_nsec;
+}
+
+
+/* fills pui8_data with reproducible synthetic data: text of skewed words, binary records with a counter and a random
+   walk, runs of random length and random bytes */
+void mdeflate_bench_generate( uint8_t *pui8_data, int64_t i64_size, int32_t i_generator )
+{
+	uint32_t ui_seed, ui_value;
+	int64_t i64_pos;
+	int32_t i_idx, i_length;
+	const char *pc_word;
+
+	ui_seed = 0x2545f491 + i_generator;
+	ui_value = 0;
+	i64_pos = 0;
+	while( i64_pos < i64_size )
+	{
+		ui_seed = ui_seed * 1664525 + 1013904223;
+		if( i_generator == MDEFLATE_BENCH_TEXT )
+		{
+			pc_word = rgpc_bench_words[ ( ( ui_seed >> 27 ) * ( ( ui_seed >> 22 ) & 31 ) ) >> 5 ];
+			for( i_idx = 0; pc_word[ i_idx ] != 0 && i64_pos < i64_size; i_idx++ )
+			{
+				pui8_data[ i64_pos++ ] = pc_word[ i_idx ];
+			}
+			if( i64_pos < i64_size )
+			{
+				pui8_data[ i64_pos++ ] = ( ui_seed & 15 ) == 0 ? '\n' : ' ';
+			}
+		}
+		else if( i_generator == MDEFLATE_BENCH_BINARY )
+		{
+			uint8_t rgui8_record[ 16 ];
+
+			ui_value += ( ui_seed >> 28 ) - 7;
+			mdeflate_store_be32( &rgui8_record[ 0 ], ( uint32_t )( i64_pos / 16 ) );
+			mdeflate_store_be32( &rgui8_record[ 4 ], ( ui_seed >> 13 ) & 7 );
+			mdeflate_store_be32( &rgui8_record[ 8 ], ui_value );
+			mdeflate_store_be32( &rgui8_record[ 12 ], ui_seed & 0xffff );
+			for( i_idx = 0; i_idx < 16 && i64_pos < i64_size; i_idx++ )
+			{
+				pui8_data[ i64_pos++ ] = rgui8_record[ i_idx ];
+			}
+		}
+		else if( i_generator == MDEFLATE_BENCH_RUNS )
+		{
+			i_length = 1 + ( ( ui_seed >> 8 ) & 31 );
+			for( i_idx = 0; i_idx < i_length && i64_pos < i64_size; i_idx++ )
+			{
+				pui8_data[ i64_pos++ ] = ( uint8_t )( ui_seed >> 24 );
+			}
+		}
+		else
+		{
+			pui8_data[ i64_pos++ ] = ( uint8_t )( ui_seed >> 24 );
+		}
+	}
+}
+
+
+/* compresses pui8_data block by block like mdeflate_enc_blocks with a single thread and decodes the blocks in order
+   i_repeats times with the kernels for i_cpu_features or, if negative, the detected ones. returns -1 if out of memory
+   or the data does not survive the round trip */
+int32_t mdeflate_bench_run( mdeflate_bench_t *ps_bench, uint8_t *pui8_data, int64_t i64_size, const mdeflate_params_t *ps_params, int32_t i_repeats, int32_t i_cpu_features )
+{
+	mdeflate_compress_t *ps_compress;
+	minflate_uncompress_t *ps_uncompress;
+	uint8_t *pui8_edata, *pui8_ddata;
+	int64_t i64_pos, i64_epos, i64_ns, i64_ticks;
+	int32_t i_repeat, i_length, i_block_size, i_length_bytes, i_ret;
+	mdeflate_stats_t s_compress_stats, s_uncompress_stats;
+
+	memset( ps_bench, 0, sizeof( mdeflate_bench_t ) );
+	memset( &s_compress_stats, 0, sizeof( mdeflate_stats_t ) );
+	memset( &s_uncompress_stats, 0, sizeof( mdeflate_stats_t ) );
+	ps_bench->i64_size = i64_size;
+	ps_bench->i_repeats = i_repeats;
+	ps_compress = mdeflate_create( ps_params );
+	ps_uncompress = ps_compress == NULL ? NULL : minflate_create( &ps_compress->s_format );
+	pui8_edata = malloc( ( size_t )mdeflate_enc_blocks_bound( ps_params, i64_size ) );
+	pui8_ddata = malloc( ( size_t )i64_size + MINFLATE_OUT_SLACK );
+	i_ret = ps_uncompress == NULL || pui8_edata == NULL || pui8_ddata == NULL ? -1 : 0;
+	i_block_size = ps_compress == NULL ? 0 : ps_compress->s_format.i_block_size;
+	i_length_bytes = ps_compress == NULL ? 0 : ps_compress->s_format.i_length_bytes;
+	if( i_ret == 0 && i_cpu_features >= 0 )
+	{
+		mdeflate_bind_kernels( ps_compress, i_cpu_features );
+		minflate_bind_kernels( ps_uncompress, i_cpu_features );
+	}
+#if WITH_STAGE_TIMERS
+	if( i_ret == 0 )
+	{
+		mdeflate_set_stats( ps_compress, &s_compress_stats );
+		minflate_set_stats( ps_uncompress, &s_uncompress_stats );
+	}
+#endif
+
+	for( i_repeat = 0; i_repeat < i_repeats && i_ret == 0; i_repeat++ )
+	{
+		mdeflate_reset( ps_compress );
+		i64_ns = mdeflate_bench_ns( );
+		i64_ticks = mdeflate_ticks( );
+		i64_pos = i64_epos = 0;
+		while( i64_pos < i64_size && i_ret == 0 )
+		{
+			i_length = i64_size - i64_pos < i_block_size ? ( int32_t )( i64_size - i64_pos ) : i_block_size;
+			i_ret = mdeflate_enc_blocks_ctx( ps_compress, pui8_data + i64_pos, i_length, pui8_edata + i64_epos, i64_pos < ps_compress->i_max_codebook_back ? ( int32_t )i64_pos : ps_compress->i_max_codebook_back );
+			i64_epos += i_ret;
+			i64_pos += i_length;
+			i_ret = i_ret < 0 ? -1 : 0;
+		}
+		ps_bench->i64_compress_ticks += mdeflate_ticks( ) - i64_ticks;
+		i64_ns = mdeflate_bench_ns( ) - i64_ns;
+		if( i_repeat == 0 || i64_ns < ps_bench->i64_compress_ns )
+		{
+			ps_bench->i64_compress_ns = i64_ns;
+		}
+		ps_bench->i64_compressed_size = i64_epos;
+
+		minflate_reset( ps_uncompress );
+		i64_ns = mdeflate_bench_ns( );
+		i64_ticks = mdeflate_ticks( );
+		i64_pos = i64_epos = 0;
+		while( i64_epos < ps_bench->i64_compressed_size && i_ret == 0 )
+		{
+			i_length = ( int32_t )mdeflate_read_be( pui8_edata + i64_epos, i_length_bytes );
+			i64_epos += i_length_bytes;
+			i_ret = minflate_dec_block_ctx( ps_uncompress, pui8_edata + i64_epos, i_length, pui8_ddata + i64_pos, pui8_ddata + i64_size + MINFLATE_OUT_SLACK );
+			i64_epos += i_length;
+			i64_pos += i_ret;
+			i_ret = i_ret < 0 ? -1 : 0;
+		}
+		ps_bench->i64_decompress_ticks += mdeflate_ticks( ) - i64_ticks;
+		i64_ns = mdeflate_bench_ns( ) - i64_ns;
+		if( i_repeat == 0 || i64_ns < ps_bench->i64_decompress_ns )
+		{
+			ps_bench->i64_decompress_ns = i64_ns;
+		}
+		if( i64_pos != i64_size || ( i_repeat == 0 && memcmp( pui8_data, pui8_ddata, ( size_t )i64_size ) != 0 ) )
+		{
+			i_ret = -1;
+		}
+	}
+
+#if WITH_STAGE_TIMERS
+	if( i_ret == 0 )
+	{
+		memcpy( &ps_bench->rgi64_stage_ticks[ MDEFLATE_STAGE_MATCH ], &s_compress_stats.rgi64_stage_ticks[ MDEFLATE_STAGE_MATCH ], sizeof( int64_t ) * ( MDEFLATE_STAGE_SYMBOLS + 1 ) );
+		memcpy( &ps_bench->rgi64_stage_ticks[ MINFLATE_STAGE_TABLES ], &s_uncompress_stats.rgi64_stage_ticks[ MINFLATE_STAGE_TABLES ], sizeof( int64_t ) * ( MINFLATE_STAGE_DECODE + 1 - MINFLATE_STAGE_TABLES ) );
+	}
+#endif
+	if( ps_compress != NULL )
+	{
+		mdeflate_destroy( ps_compress );
+	}
+	if( ps_uncompress != NULL )
+	{
+		minflate_destroy( ps_uncompress );
+	}
+	free( pui8_edata );
+	free( pui8_ddata );
+	return i_ret;
+}
+
+
+/* prints one result as csv line, with the column names before the first, or as json object */
+void mdeflate_bench_print( const char *pc_name, int32_t i_level, mdeflate_bench_t *ps_bench, int32_t i_json, int32_t i_first )
+{
+	const char *rgpc_stages[ MDEFLATE_NUM_STAGES ] = { "match", "tree", "header", "symbols", "tables", "decode" };
+	double d_bytes, d_all_bytes;
+	int32_t i_stage;
+
+	d_bytes = ps_bench->i64_size > 0 ? ( double )ps_bench->i64_size : 1.0;
+	d_all_bytes = d_bytes * ps_bench->i_repeats;
+	if( i_json )
+	{
+		printf( "%s\n  { \"name\": \"%s\", \"level\": %d, \"size\": %lld, \"compressed\": %lld, \"ratio\": %.4f, ", i_first ? "" : ",", pc_name, i_level,
+			( long long )ps_bench->i64_size, ( long long )ps_bench->i64_compressed_size, ps_bench->i64_compressed_size / d_bytes );
+		printf( "\"compress_mbs\": %.2f, \"decompress_mbs\": %.2f, \"compress_cpb\": %.3f, \"decompress_cpb\": %.3f", d_bytes * 1000.0 / ( ps_bench->i64_compress_ns + 1 ),
+			d_bytes * 1000.0 / ( ps_bench->i64_decompress_ns + 1 ), ps_bench->i64_compress_ticks / d_all_bytes, ps_bench->i64_decompress_ticks / d_all_bytes );
+		for( i_stage = 0; i_stage < MDEFLATE_NUM_STAGES; i_stage++ )
+		{
+			printf( ", \"%s_cpb\": %.3f", rgpc_stages[ i_stage ], ps_bench->rgi64_stage_ticks[ i_stage ] / d_all_bytes );
+		}
+		printf( " }" );
+		return;
+	}
+	if( i_first )
+	{
+		printf( "name,level,size,compressed,ratio,compress_mbs,decompress_mbs,compress_cpb,decompress_cpb" );
+		for( i_stage = 0; i_stage < MDEFLATE_NUM_STAGES; i_stage++ )
+		{
+			printf( ",%s_cpb", rgpc_stages[ i_stage ] );
+		}
+		printf( "\n" );
+	}
+	printf( "%s,%d,%lld,%lld,%.4f,%.2f,%.2f,%.3f,%.3f", pc_name, i_level, ( long long )ps_bench->i64_size, ( long long )ps_bench->i64_compressed_size, ps_bench->i64_compressed_size / d_bytes,
+		d_bytes * 1000.0 / ( ps_bench->i64_compress_ns + 1 ), d_bytes * 1000.0 / ( ps_bench->i64_decompress_ns + 1 ), ps_bench->i64_compress_ticks / d_all_bytes, ps_bench->i64_decompress_ticks / d_all_bytes );
+	for( i_stage = 0; i_stage < MDEFLATE_NUM_STAGES; i_stage++ )
+	{
+		printf( ",%.3f", ps_bench->rgi64_stage_ticks[ i_stage ] / d_all_bytes );
+	}
+	printf( "\n" );
+}
+
+
+uint8_t *mdeflate_bench_read_file( const char *pc_file, int64_t *pi64_size )
+{
+	FILE *f_in;
+	uint8_t *pui8_data;
+
+	f_in = fopen( pc_file, "rb" );
+	if( f_in == NULL )
+	{
+		return NULL;
+	}
+	*pi64_size = fseek( f_in, 0, SEEK_END ) == 0 ? ftell( f_in ) : -1;
+	if( *pi64_size < 0 || fseek( f_in, 0, SEEK_SET ) != 0 )
+	{
+		*pi64_size = -1;
+	}
+	pui8_data = *pi64_size < 0 ? NULL : malloc( ( size_t )*pi64_size + 1 );
+	if( pui8_data != NULL && *pi64_size > 0 && fread( pui8_data, ( size_t )*pi64_size, 1, f_in ) != 1 )
+	{
+		free( pui8_data );
+		pui8_data = NULL;
+	}
+	fclose( f_in );
+	return pui8_data;
+}
+
+#endif
+
+
+int32_t mdeflate_write_file( FILE *f_out, const uint8_t *pui8_data, int64_t i64_size )
+{
+	if( i64_size > 0 && fwrite( pui8_data, ( size_t )i64_size, 1, f_out ) != 1 )
+	{
+		return -1;
+	}
+	return 0;
+}
+
+
+/* ------------------------ MAIN ------------------------ */
+
+
+int main( int i_argc, char *argv[ ] )
+{
+	FILE *f_in, *f_out;
+	uint8_t rgui8_edata[ MDEFLATE_MAX_ENC_BLOCK_SIZE ];
+	uint8_t rgui8_ddata[ MDEFLATE_BLOCK_SIZE + MINFLATE_OUT_SLACK ];
+	uint8_t *pui8_data, *pui8_edata;
+	int32_t i_data_size, i_ddata_size, i_ret, i_cb_size, i_arg, i_level, i_threads, i_chunk_size, i_reset_blocks;
+	int32_t i_edata_size, i_edata_pos, i_in_used, i_window_log, i_block_log, i_window, i_byte_literals, i_dict_size, i_train, i_bench;
+#if WITH_BENCH
+	int32_t i_repeats, i_json, i_cpu_features;
+#endif
+	int64_t i64_edata_size, i64_offset, i64_length;
+	char *pc_in_file, *pc_out_file;
+	mdeflate_params_t s_params;
+	mdeflate_format_t s_format;
+	mdeflate_index_t s_index;
+	minflate_stream_t *ps_dstream;
+
+	i_level = MDEFLATE_DEFAULT_LEVEL;
+	i_threads = 1;
+	i_reset_blocks = 0;
+	i_window_log = i_block_log = 0;
+	i_byte_literals = -1;
+	i_dict_size = 0;
+#if WITH_BENCH
+	i_repeats = MDEFLATE_BENCH_REPEATS;
+	i_json = 0;
+	i_cpu_features = -1;
+#endif
+	i64_offset = 0;
+	i64_length = -1;
+	for( i_arg = 2; i_arg + 1 < i_argc && argv[ i_arg ][ 0 ] == '-'; i_arg += 2 )
+	{
+		if( strcmp( argv[ i_arg ], "-l" ) == 0 )
+		{
+			i_level = atoi( argv[ i_arg + 1 ] );
+		}
+		else if( strcmp( argv[ i_arg ], "-R" ) == 0 )
+		{
+			i_reset_blocks = atoi( argv[ i_arg + 1 ] );
+		}
+		else if( strcmp( argv[ i_arg ], "-W" ) == 0 )
+		{
+			i_window_log = atoi( argv[ i_arg + 1 ] );
+		}
+		else if( strcmp( argv[ i_arg ], "-B" ) == 0 )
+		{
+			i_block_log = atoi( argv[ i_arg + 1 ] );
+		}
+		else if( strcmp( argv[ i_arg ], "-b" ) == 0 )
+		{
+			i_byte_literals = atoi( argv[ i_arg + 1 ] ) != 0;
+		}
+		else if( strcmp( argv[ i_arg ], "-s" ) == 0 )
+		{
+			i_dict_size = atoi( argv[ i_arg + 1 ] );
+		}
+#if WITH_BENCH
+		else if( strcmp( argv[ i_arg ], "-i" ) == 0 )
+		{
+			i_repeats = atoi( argv[ i_arg + 1 ] );
+			if( i_repeats < 1 )
+			{
+				i_repeats = 1;
+			}
+		}
+		else if( strcmp( argv[ i_arg ], "-C" ) == 0 )
+		{
+			i_cpu_features = ( int32_t )strtol( argv[ i_arg + 1 ], NULL, 0 ) & mdeflate_cpu_features( );
+		}
+		else if( strcmp( argv[ i_arg ], "-F" ) == 0 )
+		{
+			i_json = strcmp( argv[ i_arg + 1 ], "json" ) == 0;
+		}
+#endif
+		else if( strcmp( argv[ i_arg ], "-o" ) == 0 )
+		{
+			i64_offset = strtoll( argv[ i_arg + 1 ], NULL, 10 );
+		}
+		else if( strcmp( argv[ i_arg ], "-n" ) == 0 )
+		{
+			i64_length = strtoll( argv[ i_arg + 1 ], NULL, 10 );
+		}
+		else if( strcmp( argv[ i_arg ], "-T" ) == 0 )
+		{
+			i_threads = atoi( argv[ i_arg + 1 ] );
+			if( i_threads < 1 || i_threads > MDEFLATE_MAX_THREADS )
+			{
+				i_threads = 1;
+			}
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	i_train = i_argc > 1 && strcmp( argv[ 1 ], "train" ) == 0;
+	i_bench = WITH_BENCH && i_argc > 1 && strcmp( argv[ 1 ], "bench" ) == 0;
+	if( i_argc - i_arg != 2 && !( i_train && i_argc - i_arg > 2 ) && !( i_bench && i_argc - i_arg == 1 ) )
+	{
+		printf("usage: <option> [-l level] [-T threads] [-R blocks] [-W log] [-B log] [-b 0|1] [-o offset] [-n length] infile outfile\nwhere option is either 'c' for compress, 'd' for decompress or 'r' to decompress a range of an indexed file\n");
+		printf("   or: train [-s size] [-l level] [-W log] [-B log] sample [sample ...] dictfile to build a preset dictionary\n");
+#if WITH_BENCH
+		printf("   or: bench [-l level] [-W log] [-B log] [-b 0|1] [-s size] [-i repeats] [-C features] [-F csv|json] directory|file|text|binary|runs|random|all\n");
+#endif
+		printf("-l level: compression level %d (literals only) to %d (optimal parse), default %d\n", MDEFLATE_MIN_LEVEL, MDEFLATE_MAX_LEVEL, MDEFLATE_DEFAULT_LEVEL );
+		printf("-T threads: number of compression or decompression threads, default 1\n");
+		printf("-R blocks: write a reset point every 'blocks' blocks and append a block index\n");
+		printf("-W log, -B log: window and block size of 2^log bytes, %d to %d, written to a stream header. without both the headerless legacy format is used\n", MDEFLATE_MIN_LOG, MDEFLATE_MAX_LOG );
+		printf("-b 0|1: disable or allow blocks with a byte literal tree, default 0. decoders built without WITH_BYTE_LITERALS can not read them\n");
+		printf("-o offset, -n length: uncompressed range to decompress with 'r'\n");
+		printf("-s size: dictionary size in bytes, at most and by default the window size, or the size of synthetic bench data\n");
+#if WITH_BENCH
+		printf("-i repeats, -F csv|json: bench runs per input, default %d, and output format, default csv\n", MDEFLATE_BENCH_REPEATS );
+		printf("-C features: bench kernels for these of the detected cpu features only, sse2 %d, ssse3 %d, avx2 %d, bmi2 %d, detected %d\n",
+			MDEFLATE_CPU_SSE2, MDEFLATE_CPU_SSSE3, MDEFLATE_CPU_AVX2, MDEFLATE_CPU_BMI2, mdeflate_cpu_features( ) );
+#endif
+		exit( 1 );
+	}
+	pc_in_file = argv[ i_arg ];
+	pc_out_file = argv[ i_arg + 1 ];
+	mdeflate_init_params( &s_params, i_level );
+	s_params.i_reset_blocks = i_reset_blocks;
+	s_params.i_window_log = i_window_log;
+	s_params.i_block_log = i_block_log;
+	if( i_byte_literals >= 0 )
+	{
+		s_params.i_byte_literals = i_byte_literals;
+	}
+	mdeflate_init_format( &s_format, i_window_log, i_block_log );
+
+#if WITH_BENCH
+	if( i_bench )
+	{
+		mdeflate_bench_t s_bench;
+		DIR *ps_dir;
+		struct dirent *ps_entry;
+		char rgc_path[ 4096 ];
+		int32_t i_generator, i_first, i_single;
+		int64_t i64_size;
+
+		pc_in_file = argv[ i_arg ];
+		i_first = 1;
+		if( i_json )
+		{
+			printf( "[" );
+		}
+		for( i_generator = 0; i_generator < MDEFLATE_BENCH_GENERATORS; i_generator++ )
+		{
+			if( strcmp( pc_in_file, rgpc_bench_generators[ i_generator ] ) != 0 && strcmp( pc_in_file, "all" ) != 0 )
+			{
+				continue;
+			}
+			i64_size = i_dict_size > 0 ? i_dict_size : MDEFLATE_BENCH_SIZE;
+			pui8_data = malloc( ( size_t )i64_size );
+			if( pui8_data == NULL )
+			{
+				printf("unable to allocate %lld bytes\n", ( long long )i64_size );
+				exit( 1 );
+			}
+			mdeflate_bench_generate( pui8_data, i64_size, i_generator );
+			if( mdeflate_bench_run( &s_bench, pui8_data, i64_size, &s_params, i_repeats, i_cpu_features ) < 0 )
+			{
+				printf("bench of %s failed\n", rgpc_bench_generators[ i_generator ] );
+				exit( 1 );
+			}
+			mdeflate_bench_print( rgpc_bench_generators[ i_generator ], i_level, &s_bench, i_json, i_first );
+			i_first = 0;
+			free( pui8_data );
+		}
+
+		/* a directory is benched file by file, anything else that is not a generator as a single file */
+		ps_dir = i_first ? opendir( pc_in_file ) : NULL;
+		i_single = i_first && ps_dir == NULL;
+		ps_entry = NULL;
+		while( i_single || ( ps_dir != NULL && ( ps_entry = readdir( ps_dir ) ) != NULL ) )
+		{
+			if( i_single )
+			{
+				snprintf( rgc_path, sizeof( rgc_path ), "%s", pc_in_file );
+			}
+			else if( ps_entry->d_name[ 0 ] == '.' )
+			{
+				continue;
+			}
+			else
+			{
+				snprintf( rgc_path, sizeof( rgc_path ), "%s/%s", pc_in_file, ps_entry->d_name );
+			}
+			pui8_data = mdeflate_bench_read_file( rgc_path, &i64_size );
+			if( pui8_data == NULL )
+			{
+				if( i_single )
+				{
+					printf("unable to read \"%s\"\n", rgc_path );
+					exit( 1 );
+				}
+				continue; /* subdirectories and unreadable files */
+			}
+			if( mdeflate_bench_run( &s_bench, pui8_data, i64_size, &s_params, i_repeats, i_cpu_features ) < 0 )
+			{
+				printf("bench of \"%s\" failed\n", rgc_path );
+				exit( 1 );
+			}
+			mdeflate_bench_print( i_single ? rgc_path : ps_entry->d_name, i_level, &s_bench, i_json, i_first );
+			i_first = 0;
+			free( pui8_data );
+			if( i_single )
+			{
+				break;
+			}
+		}
+		if( ps_dir != NULL )
+		{
+			closedir( ps_dir );
+		}
+		if( i_json )
+		{
+			printf( "\n]\n" );
+		}
+	}
+	else
+#endif
+	if( i_train )
+	{
+		int32_t *pi_sample_lengths, i_num_samples, i_sample, i_dict_length;
+		int64_t i64_samples_size, i64_plain_size, i64_dict_size, i64_sample_pos;
+		mdeflate_compress_t *ps_compress, *ps_dcompress;
+
+		i_num_samples = i_argc - i_arg - 1;
+		pc_out_file = argv[ i_argc - 1 ];
+		pi_sample_lengths = malloc( sizeof( int32_t ) * i_num_samples );
+		if( pi_sample_lengths == NULL )
+		{
+			printf("unable to allocate training buffers\n");
+			exit( 1 );
+		}
+		if( i_dict_size <= 0 || i_dict_size > s_format.i_window_size )
+		{
+			i_dict_size = s_format.i_window_size;
+		}
+		pui8_data = NULL;
+		i64_samples_size = 0;
+		for( i_sample = 0; i_sample < i_num_samples; i_sample++ )
+		{
+			pc_in_file = argv[ i_arg + i_sample ];
+			f_in = fopen( pc_in_file, "rb" );
+			if( f_in == NULL )
+			{
+				printf("unable to open \"%s\" for reading\n", pc_in_file );
+				exit( 1 );
+			}
+			fseek( f_in, 0, SEEK_END );
+			pi_sample_lengths[ i_sample ] = ( int32_t )ftell( f_in );
+			fseek( f_in, 0, SEEK_SET );
+			pui8_data = realloc( pui8_data, ( size_t )i64_samples_size + pi_sample_lengths[ i_sample ] + 1 );
+			if( pui8_data == NULL || ( pi_sample_lengths[ i_sample ] > 0 && fread( &pui8_data[ i64_samples_size ], pi_sample_lengths[ i_sample ], 1, f_in ) != 1 ) )
+			{
+				printf("unable to read \"%s\"\n", pc_in_file );
+				exit( 1 );
+			}
+			fclose( f_in );
+			i64_samples_size += pi_sample_lengths[ i_sample ];
+		}
+
+		pui8_edata = malloc( ( size_t )i_dict_size + s_format.i_enc_block_bound );
+		i_dict_length = pui8_edata == NULL ? -1 : mdeflate_train_dict( pui8_data, pi_sample_lengths, i_num_samples, pui8_edata, i_dict_size );
+		if( i_dict_length < 0 )
+		{
+			printf("unable to allocate training buffers\n");
+			exit( 1 );
+		}
+		f_out = fopen( pc_out_file, "wb" );
+		if( f_out == NULL || ( i_dict_length > 0 && fwrite( pui8_edata, i_dict_length, 1, f_out ) != 1 ) )
+		{
+			printf("unable to write to \"%s\"\n", pc_out_file );
+			exit( 1 );
+		}
+		fclose( f_out );
+
+		/* compress the samples, or their first block, with and without the dictionary */
+		ps_compress = mdeflate_create( &s_params );
+		ps_dcompress = mdeflate_create( &s_params );
+		if( ps_compress == NULL || ps_dcompress == NULL || mdeflate_set_dict( ps_dcompress, pui8_edata, i_dict_length ) < 0 )
+		{
+			printf("unable to allocate compression contexts\n");
+			exit( 1 );
+		}
+		i64_plain_size = i64_dict_size = i64_sample_pos = 0;
+		for( i_sample = 0; i_sample < i_num_samples; i_sample++ )
+		{
+			i_data_size = pi_sample_lengths[ i_sample ] < s_format.i_block_size ? pi_sample_lengths[ i_sample ] : s_format.i_block_size;
+			mdeflate_reset( ps_compress );
+			i64_plain_size += mdeflate_enc_block_ctx( ps_compress, &pui8_data[ i64_sample_pos ], i_data_size, pui8_edata + i_dict_length, 0 );
+			i64_dict_size += mdeflate_enc_block_dict( ps_dcompress, &pui8_data[ i64_sample_pos ], i_data_size, pui8_edata + i_dict_length );
+			i64_sample_pos += pi_sample_lengths[ i_sample ];
+		}
+		printf( "%d samples, %lld bytes, %d byte dictionary\n", i_num_samples, ( long long )i64_samples_size, i_dict_length );
+		printf( "without dictionary %lld, with dictionary %lld ( %.2f )\n", ( long long )i64_plain_size, ( long long )i64_dict_size, i64_plain_size > 0 ? ( float )i64_dict_size / ( float )i64_plain_size : 1.0f );
+
+		mdeflate_destroy( ps_compress );
+		mdeflate_destroy( ps_dcompress );
+		free( pi_sample_lengths );
+		free( pui8_data );
+		free( pui8_edata );
+	}
+	else if( argv[ 1 ][ 0 ] == 'c' && argv[ 1 ][ 1 ] == 0 )
+	{
+		f_in = fopen( pc_in_file, "rb" );
+		if( f_in == NULL )
+		{
+			printf("unable to open \"%s\" for reading\n", pc_in_file );
+			exit( 1 );
+		}
+		f_out = fopen( pc_out_file, "wb" );
+		if( f_out == NULL )
+		{
+			printf("unable to open \"%s\" for writing\n", pc_out_file );
+			exit( 1 );
+		}
+
+		i_window = s_format.i_window_size;
+		/* a chunk holds whole groups of blocks, 4 per thread but not more than MDEFLATE_MAX_CHUNK_SIZE */
+		i64_edata_size = ( int64_t )( i_reset_blocks > 0 ? i_reset_blocks : MDEFLATE_JOB_BLOCKS ) * s_format.i_block_size;
+		if( i64_edata_size > MDEFLATE_MAX_CHUNK_SIZE )
+		{
+			printf("-R blocks of the block size exceed %d bytes\n", MDEFLATE_MAX_CHUNK_SIZE );
+			exit( 1 );
+		}
+		i_chunk_size = ( int32_t )i64_edata_size * ( i_threads * 4 < MDEFLATE_MAX_CHUNK_SIZE / i64_edata_size ? i_threads * 4 : ( int32_t )( MDEFLATE_MAX_CHUNK_SIZE / i64_edata_size ) );
+		pui8_data = malloc( ( size_t )i_window + i_chunk_size );
+		pui8_edata = malloc( ( size_t )mdeflate_enc_blocks_bound( &s_params, i_chunk_size ) + MDEFLATE_HEADER_SIZE );
+		mdeflate_init_index( &s_index );
+		if( pui8_data == NULL || pui8_edata == NULL )
+		{
+			printf("unable to allocate compression buffers\n");
+			exit( 1 );
+		}
+
+		s_index.i64_compressed_size = mdeflate_write_header( &s_format, pui8_edata );
+		if( mdeflate_write_file( f_out, pui8_edata, s_index.i64_compressed_size ) < 0 )
+		{
+			printf("unable to write to \"%s\"\n", pc_out_file );
+			exit( 1 );
+		}
+
+		i_cb_size = 0;
+		while( 1 )
+		{
+			i_data_size = fread( &pui8_data[ i_window ], sizeof( uint8_t ), i_chunk_size, f_in );
+#if MDEFLATE_DEBUG_PRINTF > 0
+			printf("chunk, %d bytes\n", i_data_size );
+#endif
+			if( i_data_size <= 0 )
+			{
+				break;
+			}
+			if( i_reset_blocks > 0 )
+			{
+				i64_edata_size = mdeflate_enc_frame_chunk( &s_index, &pui8_data[ i_window ], i_data_size, pui8_edata, i_cb_size, &s_params, i_threads );
+			}
+			else
+			{
+				i64_edata_size = mdeflate_enc_blocks( &pui8_data[ i_window ], i_data_size, pui8_edata, i_cb_size, &s_params, i_threads );
+			}
+			if( i64_edata_size < 0 )
+			{
+				printf("compression failed\n");
+				exit( 1 );
+			}
+			if( mdeflate_write_file( f_out, pui8_edata, i64_edata_size ) < 0 )
+			{
+				printf("unable to write to \"%s\"\n", pc_out_file );
+				exit( 1 );
+			}
+			printf( "%d %d ( %.2f )\n", i_data_size, ( int32_t )i64_edata_size, ( ( float ) i64_edata_size ) / ( ( float )i_data_size ) );
+
+			i_cb_size += i_data_size;
+			if( i_cb_size > i_window )
+			{
+				i_cb_size = i_window;
+			}
+			memmove( &pui8_data[ i_window - i_cb_size ], &pui8_data[ i_window + i_data_size - i_cb_size ], i_cb_size );
+		}
+		if( mdeflate_write_file( f_out, pui8_edata, mdeflate_write_terminator( &s_format, pui8_edata ) ) < 0 )
+		{
+			printf("unable to write to \"%s\"\n", pc_out_file );
+			exit( 1 );
+		}
+
+		if( i_reset_blocks > 0 )
+		{
+			uint8_t *pui8_index = malloc( MDEFLATE_INDEX_SIZE( s_index.i_num_entries ) );
+			if( pui8_index == NULL )
+			{
+				printf("unable to allocate index\n");
+				exit( 1 );
+			}
+			i64_edata_size = mdeflate_write_index( &s_index, pui8_index );
+			if( mdeflate_write_file( f_out, pui8_index, i64_edata_size ) < 0 )
+			{
+				printf("unable to write to \"%s\"\n", pc_out_file );
+				exit( 1 );
+			}
+			free( pui8_index );
+		}
+		mdeflate_free_index( &s_index );
+
+		free( pui8_data );
+		free( pui8_edata );
+	}
+	else if( argv[ 1 ][ 0 ] == 'd' && argv[ 1 ][ 1 ] == 0 && i_threads > 1 )
+	{
+		int64_t i64_frame_size, i64_max_batch;
+		int32_t i_group, i_num_groups;
+
+		f_in = fopen( pc_in_file, "rb" );
+		if( f_in == NULL )
+		{
+			printf("unable to open \"%s\" for reading\n", pc_in_file );
+			exit( 1 );
+		}
+		f_out = fopen( pc_out_file, "wb" );
+		if( f_out == NULL )
+		{
+			printf("unable to open \"%s\" for writing\n", pc_out_file );
+			exit( 1 );
+		}
+
+		fseek( f_in, 0, SEEK_END );
+		i64_frame_size = ftell( f_in );
+		fseek( f_in, 0, SEEK_SET );
+		pui8_edata = malloc( ( size_t )i64_frame_size + 1 );
+		if( pui8_edata == NULL || fread( pui8_edata, ( size_t )i64_frame_size, 1, f_in ) != 1 || minflate_read_index( pui8_edata, i64_frame_size, &s_index ) < 0 )
+		{
+			printf("\"%s\" is no indexed file, use -R when compressing for multithreaded decompression\n", pc_in_file );
+			exit( 1 );
+		}
+
+		/* decode up to 4 groups per thread at once into a buffer for the largest batch */
+		i64_max_batch = 0;
+		for( i_group = 0; i_group < s_index.i_num_entries; i_group += i_threads * 4 )
+		{
+			i_num_groups = s_index.i_num_entries - i_group < i_threads * 4 ? s_index.i_num_entries - i_group : i_threads * 4;
+			i64_length = ( i_group + i_num_groups < s_index.i_num_entries ? s_index.ps_entries[ i_group + i_num_groups ].i64_uncompressed_offset : s_index.i64_uncompressed_size ) -
+				s_index.ps_entries[ i_group ].i64_uncompressed_offset;
+			if( i64_length > i64_max_batch )
+			{
+				i64_max_batch = i64_length;
+			}
+		}
+		pui8_data = malloc( ( size_t )i64_max_batch + MINFLATE_OUT_SLACK );
+		if( pui8_data == NULL )
+		{
+			printf("unable to allocate %lld bytes\n", ( long long )i64_max_batch );
+			exit( 1 );
+		}
+		for( i_group = 0; i_group < s_index.i_num_entries; i_group += i_num_groups )
+		{
+			i_num_groups = s_index.i_num_entries - i_group;
+			if( i_num_groups > i_threads * 4 )
+			{
+				i_num_groups = i_threads * 4;
+			}
+			i64_length = minflate_dec_groups( pui8_edata, &s_index, i_group, i_num_groups, pui8_data, i_threads );
+			if( i64_length < 0 )
+			{
+				printf("decompression failed\n");
+				exit( 1 );
+			}
+			if( mdeflate_write_file( f_out, pui8_data, i64_length ) < 0 )
+			{
+				printf("unable to write to \"%s\"\n", pc_out_file );
+				exit( 1 );
+			}
+			printf( "%d groups -> %lld\n", i_num_groups, ( long long )i64_length );
+		}
+
+		mdeflate_free_index( &s_index );
+		free( pui8_data );
+		free( pui8_edata );
+	}
+	else if( argv[ 1 ][ 0 ] == 'd' && argv[ 1 ][ 1 ] == 0 )
+	{
+		f_in = fopen( pc_in_file, "rb" );
+		if( f_in == NULL )
+		{
+			printf("unable to open \"%s\" for reading\n", pc_in_file );
+			exit( 1 );
+		}
+		f_out = fopen( pc_out_file, "wb" );
+		if( f_out == NULL )
+		{
+			printf("unable to open \"%s\" for writing\n", pc_out_file );
+			exit( 1 );
+		}
+		
+		ps_dstream = minflate_stream_create( );
+		if( ps_dstream == NULL )
+		{
+			printf("unable to create decompression stream\n");
+			exit( 1 );
+		}
+
+		i_ret = 0;
+		while( i_ret == 0 )
+		{
+			i_edata_size = ( int32_t )fread( &rgui8_edata[ 0 ], 1, sizeof( rgui8_edata ), f_in );
+			i_edata_pos = 0;
+			do {
+				i_ret = minflate_stream_decompress( ps_dstream, &rgui8_edata[ i_edata_pos ], i_edata_size - i_edata_pos, &i_in_used, &rgui8_ddata[ 0 ], sizeof( rgui8_ddata ), &i_ddata_size );
+				if( i_ret < 0 )
+				{
+					printf("decompression failed\n");
+					exit( 1 );
+				}
+				i_edata_pos += i_in_used;
+				if( mdeflate_write_file( f_out, &rgui8_ddata[ 0 ], i_ddata_size ) < 0 )
+				{
+					printf("unable to write to \"%s\"\n", pc_out_file );
+					exit( 1 );
+				}
+			} while( i_ret == 0 && ( i_edata_pos < i_edata_size || i_ddata_size == sizeof( rgui8_ddata ) ) );
+			if( i_ret == 0 && i_edata_size == 0 )
+			{
+				printf("unexpected end of \"%s\"\n", pc_in_file );
+				exit( 1 );
+			}
+		}
+		minflate_stream_destroy( ps_dstream );
+	}
+	else if( argv[ 1 ][ 0 ] == 'r' && argv[ 1 ][ 1 ] == 0 )
+	{
+		int64_t i64_frame_size;
+
+		f_in = fopen( pc_in_file, "rb" );
+		if( f_in == NULL )
+		{
+			printf("unable to open \"%s\" for reading\n", pc_in_file );
+			exit( 1 );
+		}
+		f_out = fopen( pc_out_file, "wb" );
+		if( f_out == NULL )
+		{
+			printf("unable to open \"%s\" for writing\n", pc_out_file );
+			exit( 1 );
+		}
+
+		fseek( f_in, 0, SEEK_END );
+		i64_frame_size = ftell( f_in );
+		fseek( f_in, 0, SEEK_SET );
+		pui8_edata = malloc( ( size_t )i64_frame_size + 1 );
+		if( pui8_edata == NULL || fread( pui8_edata, ( size_t )i64_frame_size, 1, f_in ) != 1 || minflate_read_index( pui8_edata, i64_frame_size, &s_index ) < 0 )
+		{
+			printf("\"%s\" is no indexed file\n", pc_in_file );
+			exit( 1 );
+		}
+		if( i64_length < 0 || i64_length > s_index.i64_uncompressed_size )
+		{
+			i64_length = s_index.i64_uncompressed_size;
+		}
+		pui8_data = malloc( ( size_t )i64_length + 1 );
+		if( pui8_data == NULL )
+		{
+			printf("unable to allocate %lld bytes\n", ( long long )i64_length );
+			exit( 1 );
+		}
+		i64_length = minflate_dec_range( pui8_edata, &s_index, i64_offset, i64_length, pui8_data );
+		if( i64_length < 0 )
+		{
+			printf("decompression failed\n");
+			exit( 1 );
+		}
+		if( mdeflate_write_file( f_out, pui8_data, i64_length ) < 0 )
+		{
+			printf("unable to write to \"%s\"\n", pc_out_file );
+			exit( 1 );
+		}
+		printf( "%lld bytes at %lld\n", ( long long )i64_length, ( long long )i64_offset );
+
+		mdeflate_free_index( &s_index );
+		free( pui8_data );
+		free( pui8_edata );
+	}
 	return 0;
 }
 